@@ -0,0 +1,107 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+#include "../General/array.h"
+
+/*
+ * Microbenchmarks for the array operations that move elements.
+ * Each one compares a trivially relocatable element type, which is moved in bulk,
+ * with an element type that has to be moved one element at a time, and with std::vector as a reference.
+ */
+
+namespace {
+
+struct Element {
+    Element(U32 v) : value(v) {}
+    Element(const Element& e) : value(e.value) {}
+    Element(Element&& e) : value(e.value) {}
+    Element& operator = (const Element& e) {value = e.value; return *this;}
+    Element& operator = (Element&& e) {value = e.value; return *this;}
+    ~Element() {}
+
+    U32 value;
+};
+
+const U32 pushCount = 1 << 20;
+const U32 middleCount = 1 << 14;
+
+template<class F>
+void measure(const char* name, U32 ops, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto time = std::chrono::steady_clock::now() - start;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    printf("%-32s %8.2f ns/op\n", name, (double)ns / ops);
+}
+
+template<class T>
+U32 value(const T& t) {return (U32)t;}
+U32 value(const Element& e) {return e.value;}
+
+template<class T>
+void benchPush(const char* name) {
+    Array<T> a;
+    measure(name, pushCount, [&] {
+        for(U32 i = 0; i < pushCount; i++) a << T(i);
+    });
+
+    ASSERT_EQ(a.size(), pushCount);
+    for(U32 i = 0; i < pushCount; i++) ASSERT_EQ(value(a[i]), i);
+}
+
+template<class T>
+void benchInsert(const char* name) {
+    Array<T> a;
+    measure(name, middleCount, [&] {
+        for(U32 i = 0; i < middleCount; i++) a.insert(a.size() / 2, i);
+    });
+
+    // The last element was inserted in the middle of the elements before it.
+    ASSERT_EQ(a.size(), middleCount);
+    ASSERT_EQ(value(a[(middleCount - 1) / 2]), middleCount - 1);
+}
+
+template<class T>
+void benchRemove(const char* name) {
+    Array<T> a(middleCount);
+    for(U32 i = 0; i < middleCount; i++) a << T(i);
+
+    measure(name, middleCount, [&] {
+        for(U32 i = 0; i < middleCount; i++) a.remove(a.size() / 2);
+    });
+
+    ASSERT_EQ(a.size(), 0u);
+}
+
+} // namespace
+
+TEST(ArrayBench, Push) {
+    benchPush<U32>("push (trivial)");
+    benchPush<Element>("push (move constructed)");
+
+    std::vector<U32> v;
+    measure("push (std::vector)", pushCount, [&] {
+        for(U32 i = 0; i < pushCount; i++) v.push_back(i);
+    });
+}
+
+TEST(ArrayBench, InsertMiddle) {
+    benchInsert<U32>("insert middle (trivial)");
+    benchInsert<Element>("insert middle (move constructed)");
+
+    std::vector<U32> v;
+    measure("insert middle (std::vector)", middleCount, [&] {
+        for(U32 i = 0; i < middleCount; i++) v.insert(v.begin() + v.size() / 2, i);
+    });
+}
+
+TEST(ArrayBench, Remove) {
+    benchRemove<U32>("remove middle (trivial)");
+    benchRemove<Element>("remove middle (move constructed)");
+
+    std::vector<U32> v(middleCount);
+    measure("remove middle (std::vector)", middleCount, [&] {
+        for(U32 i = 0; i < middleCount; i++) v.erase(v.begin() + v.size() / 2);
+    });
+}
@@ -0,0 +1,165 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include "../General/array.h"
+#include "../General/pool.h"
+
+/*
+ * Microbenchmarks for allocating small objects from several threads at once.
+ * The shared pool is compared with a normal pool behind a lock, which is what it replaces, and with malloc as a reference.
+ */
+
+namespace {
+
+struct Object {
+    U64 data[4];
+};
+
+const U32 threadCount = 4;
+const U32 opCount = 1 << 20;
+const U32 liveCount = 64;
+
+template<class F>
+void measure(const char* name, U32 ops, F&& f) {
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto time = std::chrono::steady_clock::now() - start;
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(time).count();
+    printf("%-40s %8.2f ns/op\n", name, (double)ns / ops);
+}
+
+template<class F>
+void runThreads(U32 count, F&& f) {
+    std::vector<std::thread> threads;
+    for(U32 i = 0; i < count; i++) threads.emplace_back([&f, i] {f(i);});
+    for(auto& t : threads) t.join();
+}
+
+/// Allocates and frees objects on each thread, keeping a few of them alive at a time.
+template<class Alloc, class Free>
+void benchThreads(const char* name, Alloc&& alloc, Free&& free) {
+    measure(name, opCount * threadCount, [&] {
+        runThreads(threadCount, [&](U32 thread) {
+            Object* live[liveCount];
+            for(U32 i = 0; i < liveCount; i++) live[i] = alloc();
+
+            for(U32 i = 0; i < opCount; i++) {
+                auto& o = live[i % liveCount];
+                free(o);
+                o = alloc();
+                o->data[0] = thread;
+            }
+
+            for(U32 i = 0; i < liveCount; i++) free(live[i]);
+        });
+    });
+}
+
+} // namespace
+
+TEST(PoolBench, Threads) {
+    SharedPool<Object> shared{256u};
+    benchThreads("alloc/free (shared pool)",
+        [&] {return shared.alloc();},
+        [&](Object* o) {shared.free(o);}
+    );
+
+    Pool<Object> pool{256u};
+    std::mutex lock;
+    benchThreads("alloc/free (locked pool)",
+        [&] {std::lock_guard<std::mutex> l{lock}; return pool.alloc();},
+        [&](Object* o) {std::lock_guard<std::mutex> l{lock}; pool.free(o);}
+    );
+
+    benchThreads("alloc/free (malloc)",
+        [&] {return (Object*)malloc(sizeof(Object));},
+        [&](Object* o) {::free(o);}
+    );
+}
+
+TEST(PoolBench, CrossThreadFree) {
+    // One thread allocates and another frees, like a job queue.
+    SharedPool<Object> pool{256u};
+    std::mutex lock;
+    std::vector<Object*> queue;
+    bool done = false;
+
+    measure("alloc/free other thread (shared pool)", opCount, [&] {
+        std::thread consumer{[&] {
+            std::vector<Object*> objects;
+            while(true) {
+                {
+                    std::lock_guard<std::mutex> l{lock};
+                    objects.swap(queue);
+                    if(objects.empty() && done) return;
+                }
+
+                for(auto o : objects) pool.free(o);
+                objects.clear();
+            }
+        }};
+
+        std::vector<Object*> objects;
+        for(U32 i = 0; i < opCount; i++) {
+            objects.push_back(pool.alloc());
+            if(objects.size() == liveCount) {
+                std::lock_guard<std::mutex> l{lock};
+                queue.insert(queue.end(), objects.begin(), objects.end());
+                objects.clear();
+            }
+        }
+
+        {
+            std::lock_guard<std::mutex> l{lock};
+            queue.insert(queue.end(), objects.begin(), objects.end());
+            done = true;
+        }
+        consumer.join();
+    });
+}
+
+TEST(PoolBench, ThreadChurn) {
+    // Many more threads than there are caches start and exit one after the other.
+    // Each one should reuse the index and the blocks of the ones before it, instead of falling back to the global list.
+    SharedPool<Object> pool{256u};
+    std::set<Object*> used;
+    U32 maxIndex = 0;
+    for(U32 i = 0; i < 256; i++) {
+        std::thread{[&] {
+            Object* live[liveCount];
+            for(U32 j = 0; j < liveCount; j++) live[j] = pool.alloc();
+            for(U32 j = 0; j < liveCount; j++) {
+                used.insert(live[j]);
+                pool.free(live[j]);
+            }
+            maxIndex = std::max(maxIndex, threadIndex());
+        }}.join();
+    }
+
+    ASSERT_LT(maxIndex, 4u);
+
+    // If the caches of exited threads were lost, each thread would need new blocks.
+    ASSERT_LE(used.size(), 256u);
+}
+
+TEST(PoolBench, StaticBufferChurn) {
+    // Threads that start after others have exited continue their slices instead of claiming new ones.
+    Tritium::StaticBuffer buffer{64 * 1024 * 1024};
+    Byte* first = nullptr;
+    Byte* last = nullptr;
+    for(U32 i = 0; i < 256; i++) {
+        std::thread{[&] {
+            auto p = (Byte*)buffer.alloc(16);
+            if(!first) first = p;
+            last = p;
+        }}.join();
+    }
+
+    ASSERT_EQ(buffer.getAllocations(), 256u);
+    ASSERT_EQ(last - first, 255 * 16);
+}
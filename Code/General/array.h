@@ -11,6 +11,15 @@
 #include <cstring>
 #include <utility>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRITIUM_BITS_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
 template<class T, class Allocator> struct ArrayT : Allocator {
     template<class U>
     struct ItT {
@@ -74,9 +83,9 @@ template<class T, class Allocator> struct ArrayT : Allocator {
 
     void remove(Size index) {
         assert(index < size());
-        auto p = this->pointer();
-        (p + index)->~T();
-        std::move(p + index + 1, p + index, size() - 1 - index);
+        auto p = this->pointer() + index;
+        p->~T();
+        moveDown(p, p + 1, count - 1 - (U32)index);
         count--;
     }
 
@@ -94,22 +103,79 @@ template<class T, class Allocator> struct ArrayT : Allocator {
     void reserve(U32 required) {reserveSpace(required);}
     Size size() const {return count;}
 
+    /// Reduces the allocated space to the number of elements in the array, if the allocator supports it.
+    void shrink_to_fit() {
+        if(this->space() == count) return;
+        if(!count) {
+            this->destroy();
+            return;
+        }
+
+        if(isTriviallyRelocatable<T>::value && this->reallocate(count)) return;
+
+        auto ptr = this->pointer();
+        this->alloc(count);
+        if(this->pointer() != ptr) {
+            relocate(this->pointer(), ptr, count);
+            this->free(ptr);
+        }
+    }
+
     T& operator [] (Size i) {return this->pointer()[i];}
     const T& operator [] (Size i) const {return this->pointer()[i];}
 
 protected:
     U32 resizeCount(U32 required) {
-        auto c = this->space() * 2;
-        if(c < required) c = required;
-        return c;
+        return Allocator::Growth::grow(this->space(), required);
+    }
+
+    /// Moves elements to a non-overlapping memory range, leaving the source range uninitialized.
+    static void relocate(T* dst, T* src, U32 n) {
+        if(isTriviallyRelocatable<T>::value) {
+            if(n) memcpy((void*)dst, (const void*)src, n * sizeof(T));
+        } else {
+            for(U32 i = 0; i < n; i++) {
+                new (dst + i) T(std::move(src[i]));
+                src[i].~T();
+            }
+        }
+    }
+
+    /// Moves elements to a higher address in a possibly overlapping memory range.
+    static void moveUp(T* dst, T* src, U32 n) {
+        if(isTriviallyRelocatable<T>::value) {
+            if(n) memmove((void*)dst, (const void*)src, n * sizeof(T));
+        } else {
+            // Start at the end, so that each element is moved before it is overwritten.
+            for(U32 i = n; i > 0; i--) {
+                new (dst + i - 1) T(std::move(src[i - 1]));
+                src[i - 1].~T();
+            }
+        }
+    }
+
+    /// Moves elements to a lower address in a possibly overlapping memory range.
+    static void moveDown(T* dst, T* src, U32 n) {
+        if(isTriviallyRelocatable<T>::value) {
+            if(n) memmove((void*)dst, (const void*)src, n * sizeof(T));
+        } else {
+            for(U32 i = 0; i < n; i++) {
+                new (dst + i) T(std::move(src[i]));
+                src[i].~T();
+            }
+        }
     }
 
     void reserveSpace(U32 required) {
         if(required > this->space()) {
             required = resizeCount(required);
+
+            // Relocatable elements can be moved by the allocator itself, which may avoid copying entirely.
+            if(isTriviallyRelocatable<T>::value && this->reallocate(required)) return;
+
             auto ptr = this->pointer();
             this->alloc(required);
-            memcpy(this->pointer(), ptr, count);
+            relocate(this->pointer(), ptr, count);
             this->free(ptr);
         }
     }
@@ -122,15 +188,13 @@ protected:
             auto ptr = this->pointer();
             this->alloc(required);
 
-            // Copy the first part.
-            memcpy(this->pointer(), ptr, offset);
-
-            // Copy the second part, with the new space in the middle.
-            if(count - offset) memcpy(this->pointer() + offset + amount, ptr + offset, count - offset);
+            // Move the first part, and then the second part with the new space in the middle.
+            relocate(this->pointer(), ptr, offset);
+            relocate(this->pointer() + offset + amount, ptr + offset, count - offset);
             this->free(ptr);
         } else {
-            // There is enough space, so we just move the memory.
-            memmove(this->pointer() + offset + amount, this->pointer() + offset, count - offset);
+            // There is enough space, so we just move the elements after the offset.
+            moveUp(this->pointer() + offset + amount, this->pointer() + offset, count - offset);
         }
     }
 
@@ -188,6 +252,7 @@ template<class T, class A>
 ArrayT<T, A>::ArrayT(ArrayT&& a) {
     if(A::hasSwap::value) {
         this->swap(a);
+        ::swap(count, a.count);
     } else {
         reserve(a.size());
         for(auto& i : a) {*this << i;}
@@ -204,7 +269,9 @@ template<class T, class A>
 ArrayT<T, A>& ArrayT<T, A>::operator = (ArrayT<T, A> a) {
     if(A::hasSwap::value) {
         this->swap(a);
+        ::swap(count, a.count);
     } else {
+        clear();
         reserve(a.size());
         for(auto& i : a) {*this << i;}
     }
@@ -213,14 +280,39 @@ ArrayT<T, A>& ArrayT<T, A>::operator = (ArrayT<T, A> a) {
 
 //----------------------------------------------------------------------------------------------------------
 
-template<class T, class Allocator> struct GeneralArrayAllocator {
+/**
+ * Growth policy for arrays, which multiplies the current space by Num/Den when an array is full.
+ * Smaller factors waste less memory, while larger ones need fewer reallocations.
+ */
+template<U32 Num, U32 Den> struct GrowthFactor {
+    static_assert(Num > Den, "arrays must grow");
+
+    static U32 grow(U32 space, U32 required) {
+        auto c = (U32)((U64)space * Num / Den);
+        if(c < 4) c = 4;
+        if(c < required) c = required;
+        return c;
+    }
+};
+
+using DefaultGrowth = GrowthFactor<2, 1>;
+
+template<class T, class Allocator, class GrowthPolicy = DefaultGrowth> struct GeneralArrayAllocator {
     using hasSwap = trueConstant;
+    using Growth = GrowthPolicy;
 
     void alloc(U32 size) {
         ptr = (T*)Allocator::alloc(size * sizeof(T));
         length = size;
     }
 
+    /// Resizes the current buffer in place if possible, moving its contents bytewise otherwise.
+    bool reallocate(U32 size) {
+        ptr = (T*)Allocator::reAlloc(ptr, size * sizeof(T));
+        length = size;
+        return true;
+    }
+
     void free(T* p) {
         Allocator::free(p);
     }
@@ -247,10 +339,16 @@ private:
 
 template<class T, U32 size> struct FixedArrayAllocator {
     using hasSwap = falseConstant;
+    using Growth = DefaultGrowth;
     void swap(FixedArrayAllocator&) {}
 
-    void alloc(U32) {
-        assert("Array overflow" == 0);
+    void alloc(U32 count) {
+        assert(count <= size && "Array overflow");
+    }
+
+    bool reallocate(U32 count) {
+        alloc(count);
+        return true;
     }
 
     void free(T*) {}
@@ -264,14 +362,66 @@ private:
     Uninitialized<T> data[size];
 };
 
+/**
+ * Stores up to a fixed number of elements inline, and moves to an allocated buffer when that overflows.
+ * This avoids allocations for the common case of small lists,
+ * while still supporting any number of elements.
+ */
+template<class T, U32 size, class Allocator> struct SmallArrayAllocator {
+    using hasSwap = falseConstant;
+    using Growth = DefaultGrowth;
+    void swap(SmallArrayAllocator&) {}
+
+    void alloc(U32 count) {
+        if(count <= size) {
+            ptr = nullptr;
+            length = size;
+        } else {
+            ptr = (T*)Allocator::alloc(count * sizeof(T));
+            length = count;
+        }
+    }
+
+    bool reallocate(U32 count) {
+        // Only an allocated buffer that stays allocated can be resized in place.
+        if(!ptr || count <= size) return false;
+        ptr = (T*)Allocator::reAlloc(ptr, count * sizeof(T));
+        length = count;
+        return true;
+    }
+
+    void free(T* p) {
+        // The inline storage is part of this object.
+        if(p != (T*)data) Allocator::free(p);
+    }
+
+    void destroy() {
+        if(ptr) Allocator::free(ptr);
+        ptr = nullptr;
+        length = size;
+    }
+
+    T* pointer() {return ptr ? ptr : (T*)data;}
+    const T* pointer() const {return ptr ? ptr : (const T*)data;}
+    U32 space() const {return length;}
+
+private:
+    T* ptr = nullptr; // Null as long as the inline storage is used.
+    U32 length = size;
+    Uninitialized<T> data[size];
+};
+
 //-----------------------------------------------------------------------------------------------------------
 
-template<class T, class A = HeapAllocator>
-using Array = ArrayT<T, GeneralArrayAllocator<T, A>>;
+template<class T, class A = HeapAllocator, class G = DefaultGrowth>
+using Array = ArrayT<T, GeneralArrayAllocator<T, A, G>>;
 
 template<class T, U32 size>
 using ArrayF = ArrayT<T, FixedArrayAllocator<T, size>>;
 
+template<class T, U32 size, class A = HeapAllocator>
+using ArrayS = ArrayT<T, SmallArrayAllocator<T, size, A>>;
+
 template<class T, class A> using Stack = Array<T, A>;
 template<class T, U32 size> using StackF = ArrayF<T, size>;
 
@@ -315,6 +465,172 @@ inline Size getBitSize(Size count) {
 
 
 
+/*
+ * Bulk operations on bit set data.
+ * These process the data in groups of 16 bytes, using SSE2 where available.
+ * The data size must be a multiple of kBitGroupSize bytes.
+ */
+
+static const Size kBitGroupSize = 16;
+
+/// Returns the number of bytes needed to store the provided number of bits in whole groups.
+inline Size getBitGroupSize(Size count) {
+    return (count + kBitGroupSize * 8 - 1) / (kBitGroupSize * 8) * kBitGroupSize;
+}
+
+inline U64 loadBits(const Byte* p) {
+    U64 v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline void storeBits(Byte* p, U64 v) {
+    memcpy(p, &v, sizeof(v));
+}
+
+inline Size countBits(U64 v) {
+#ifdef __GNUC__
+    return (Size)__builtin_popcountll(v);
+#else
+    v = v - ((v >> 1) & 0x5555555555555555ULL);
+    v = (v & 0x3333333333333333ULL) + ((v >> 2) & 0x3333333333333333ULL);
+    v = (v + (v >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+    return (Size)((v * 0x0101010101010101ULL) >> 56);
+#endif
+}
+
+/// Returns the index of the lowest set bit. The value must not be zero.
+inline Size findFirstBit(U64 v) {
+    assert(v != 0);
+#ifdef __GNUC__
+    return (Size)__builtin_ctzll(v);
+#elif defined(_MSC_VER) && defined(__X64__)
+    unsigned long pos;
+    _BitScanForward64(&pos, v);
+    return pos;
+#else
+    Size c = 0;
+    while(!(v & 1)) {
+        v >>= 1;
+        c++;
+    }
+    return c;
+#endif
+}
+
+/**
+ * Applies a binary operation to each group of bits in dst and src, storing the result in dst.
+ * @return True if any bit in dst was changed.
+ */
+template<class Op>
+forceinline bool combineBits(Byte* dst, const Byte* src, Size bytes, Op op) {
+    assert(bytes % kBitGroupSize == 0);
+
+#ifdef TRITIUM_BITS_SSE2
+    auto changed = _mm_setzero_si128();
+    for(Size i = 0; i < bytes; i += kBitGroupSize) {
+        auto a = _mm_loadu_si128((const __m128i*)(dst + i));
+        auto b = _mm_loadu_si128((const __m128i*)(src + i));
+        auto r = op(a, b);
+        changed = _mm_or_si128(changed, _mm_xor_si128(a, r));
+        _mm_storeu_si128((__m128i*)(dst + i), r);
+    }
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(changed, _mm_setzero_si128())) != 0xffff;
+#else
+    U64 changed = 0;
+    for(Size i = 0; i < bytes; i += sizeof(U64)) {
+        auto a = loadBits(dst + i);
+        auto r = op(a, loadBits(src + i));
+        changed |= a ^ r;
+        storeBits(dst + i, r);
+    }
+    return changed != 0;
+#endif
+}
+
+/// Sets dst to the union of dst and src. Returns true if dst was changed.
+inline bool unionBits(Byte* dst, const Byte* src, Size bytes) {
+#ifdef TRITIUM_BITS_SSE2
+    return combineBits(dst, src, bytes, [](__m128i a, __m128i b) {return _mm_or_si128(a, b);});
+#else
+    return combineBits(dst, src, bytes, [](U64 a, U64 b) {return a | b;});
+#endif
+}
+
+/// Sets dst to the intersection of dst and src. Returns true if dst was changed.
+inline bool intersectBits(Byte* dst, const Byte* src, Size bytes) {
+#ifdef TRITIUM_BITS_SSE2
+    return combineBits(dst, src, bytes, [](__m128i a, __m128i b) {return _mm_and_si128(a, b);});
+#else
+    return combineBits(dst, src, bytes, [](U64 a, U64 b) {return a & b;});
+#endif
+}
+
+/// Removes each bit in src from dst. Returns true if dst was changed.
+inline bool subtractBits(Byte* dst, const Byte* src, Size bytes) {
+#ifdef TRITIUM_BITS_SSE2
+    return combineBits(dst, src, bytes, [](__m128i a, __m128i b) {return _mm_andnot_si128(b, a);});
+#else
+    return combineBits(dst, src, bytes, [](U64 a, U64 b) {return a & ~b;});
+#endif
+}
+
+/// Returns true if both sets contain the same bits.
+inline bool equalBits(const Byte* a, const Byte* b, Size bytes) {
+    assert(bytes % kBitGroupSize == 0);
+
+#ifdef TRITIUM_BITS_SSE2
+    for(Size i = 0; i < bytes; i += kBitGroupSize) {
+        auto x = _mm_loadu_si128((const __m128i*)(a + i));
+        auto y = _mm_loadu_si128((const __m128i*)(b + i));
+        if(_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) return false;
+    }
+    return true;
+#else
+    return memcmp(a, b, bytes) == 0;
+#endif
+}
+
+/// Returns the number of set bits.
+inline Size countBits(const Byte* data, Size bytes) {
+    Size count = 0;
+    for(Size i = 0; i < bytes; i += sizeof(U64)) {
+        count += countBits(loadBits(data + i));
+    }
+    return count;
+}
+
+/**
+ * Returns the index of the first set bit at or after the provided index.
+ * Returns bytes * 8 if there is none.
+ */
+inline Size findNextBit(const Byte* data, Size bytes, Size from) {
+    auto word = from / 64 * sizeof(U64);
+    if(word >= bytes) return bytes * 8;
+
+    // Mask out the bits before the starting index in the first word.
+    auto v = loadBits(data + word) & (~U64(0) << (from % 64));
+    while(!v) {
+        word += sizeof(U64);
+        if(word >= bytes) return bytes * 8;
+
+#ifdef TRITIUM_BITS_SSE2
+        // Skip empty groups at once.
+        if(word % kBitGroupSize == 0) {
+            while(word < bytes && _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)(data + word)), _mm_setzero_si128())) == 0xffff) {
+                word += kBitGroupSize;
+            }
+            if(word >= bytes) return bytes * 8;
+        }
+#endif
+
+        v = loadBits(data + word);
+    }
+
+    return word * 8 + findFirstBit(v);
+}
+
+
 /*
  * Array of single bits.
  */
@@ -380,7 +696,7 @@ struct BitSet {
     void resize(Size count) {
         if(maxItems < count) {
             Size numBools = getBoolCount(count);
-            Size current = maxItems / 8;
+            Size current = data ? getBoolCount(maxItems) : 0;
             data = (Byte*)Allocator::reAlloc(data, numBools);
             maxItems = count;
             memset(data + current, 0, numBools - current);
@@ -389,24 +705,24 @@ struct BitSet {
 
     /// Sets the amount of space available and clears all existing data.
     void resizeClear(Size count) {
-        Size numBools = getBoolCount(count);
-        if(maxItems < count) {
-            data = (Byte*)Allocator::alloc(numBools);
-            maxItems = count;
+        if(!data || maxItems < count) {
+            create(count);
+        } else {
+            memset(data, 0, getBoolCount(maxItems));
         }
-
-        memset(data, 0, numBools);
     }
 
     /// Sets the amount of space available and sets all existing data to ones.
     void resizeSet(Size count) {
-        Size numBools = getBoolCount(count);
-        if(maxItems < count) {
-            data = (Byte*)Allocator::alloc(numBools);
-            maxItems = count;
-        }
+        if(!data || maxItems < count) create(count);
 
+        Size numBools = getBoolCount(maxItems);
         memset(data, 0xff, numBools);
+
+        // The bulk operations expect the bits after the end of the set to be cleared.
+        for(Size i = maxItems; i < numBools * 8; i++) {
+            setBit(data, i, false);
+        }
     }
 
     /// Removes and frees the contents of the list.
@@ -414,9 +730,62 @@ struct BitSet {
         if(data) {
             Allocator::free(data);
             data = 0;
+            maxItems = 0;
         }
     }
 
+    /// Returns the number of bits in the set.
+    Size size() const {
+        return maxItems;
+    }
+
+    /*
+     * Bulk operations.
+     * The other set must have the same size as this one.
+     * Operations that modify the set return true if any bit was changed,
+     * which can be used to detect when a dataflow analysis has reached a fixed point.
+     */
+
+    bool unionWith(const BitSet& other) {
+        assert(other.maxItems == maxItems);
+        return unionBits(data, other.data, getBoolCount(maxItems));
+    }
+
+    bool intersectWith(const BitSet& other) {
+        assert(other.maxItems == maxItems);
+        return intersectBits(data, other.data, getBoolCount(maxItems));
+    }
+
+    bool subtract(const BitSet& other) {
+        assert(other.maxItems == maxItems);
+        return subtractBits(data, other.data, getBoolCount(maxItems));
+    }
+
+    /// Returns the number of bits that are set.
+    Size count() const {
+        return countBits(data, getBoolCount(maxItems));
+    }
+
+    /// Returns the index of the first set bit, or size() if there is none.
+    Size findFirst() const {
+        return findNext(0);
+    }
+
+    /// Returns the index of the first set bit at or after the provided index, or size() if there is none.
+    Size findNext(Size from) const {
+        if(from >= maxItems) return maxItems;
+        auto i = findNextBit(data, getBoolCount(maxItems), from);
+        return i < maxItems ? i : maxItems;
+    }
+
+    bool operator == (const BitSet& other) const {
+        return maxItems == other.maxItems && equalBits(data, other.data, getBoolCount(maxItems));
+    }
+
+    bool operator != (const BitSet& other) const {
+        return !(*this == other);
+    }
+
     /**
      * Sets the bit at the provided index to the provided value.
      * @param index The index of the bit. Must be lower than the number of bits in the set.
@@ -479,10 +848,9 @@ struct BitSet {
     }
 
 private:
-    Size getBoolCount(Size bits) {
-        Size numBools = bits / 8;
-        numBools += (bits % 8) ? 1 : 0;
-        return numBools;
+    /// The data is stored in whole groups, so that bulk operations don't need to handle a partial group.
+    static Size getBoolCount(Size bits) {
+        return getBitGroupSize(bits);
     }
 
     Byte* data = nullptr;
@@ -521,7 +889,7 @@ struct BitSetF {
     };
 
     BitSetF() {
-        memset(data, 0, Count);
+        memset(data, 0, sizeof(data));
     }
 
     void set(Size index, bool isSet) {
@@ -571,8 +939,55 @@ struct BitSetF {
         return get(index);
     }
 
+    Size size() const {
+        return Count;
+    }
+
+    /*
+     * Bulk operations.
+     * Operations that modify the set return true if any bit was changed.
+     */
+
+    bool unionWith(const BitSetF& other) {
+        return unionBits(data, other.data, sizeof(data));
+    }
+
+    bool intersectWith(const BitSetF& other) {
+        return intersectBits(data, other.data, sizeof(data));
+    }
+
+    bool subtract(const BitSetF& other) {
+        return subtractBits(data, other.data, sizeof(data));
+    }
+
+    /// Returns the number of bits that are set.
+    Size count() const {
+        return countBits(data, sizeof(data));
+    }
+
+    /// Returns the index of the first set bit, or size() if there is none.
+    Size findFirst() const {
+        return findNext(0);
+    }
+
+    /// Returns the index of the first set bit at or after the provided index, or size() if there is none.
+    Size findNext(Size from) const {
+        if(from >= Count) return Count;
+        auto i = findNextBit(data, sizeof(data), from);
+        return i < Count ? i : Count;
+    }
+
+    bool operator == (const BitSetF& other) const {
+        return equalBits(data, other.data, sizeof(data));
+    }
+
+    bool operator != (const BitSetF& other) const {
+        return !(*this == other);
+    }
+
 private:
-    Byte data[(Count / 8) + ((Count % 8) ? 1 : 0)];
+    // The data is stored in whole groups, so that bulk operations don't need to handle a partial group.
+    Byte data[(Count + kBitGroupSize * 8 - 1) / (kBitGroupSize * 8) * kBitGroupSize];
 };
 
 #endif // Tritium_Core_Array_h
\ No newline at end of file
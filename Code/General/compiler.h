@@ -3,11 +3,73 @@
 
 #include "types.h"
 #include <string>
+#include <vector>
 
 namespace athena {
 
-struct CompileSettings {
+/// The kind of file the compiler produces.
+enum class OutputKind {
+    IR,       // Textual LLVM IR.
+    Assembly, // Native assembly for the target.
+    Object    // A native object file for the target.
+};
 
+struct CompileSettings {
+    /// The names of the functions the program is compiled for, such as main or any exported symbols.
+    /// If this is set, only declarations that are reachable from these functions are resolved and generated.
+    /// Otherwise, every declaration in the module is compiled.
+    std::vector<std::string> entryPoints;
+
+    /// If set, each top-level declaration is resolved and generated as soon as everything it uses has been declared,
+    /// instead of after the whole module has been parsed.
+    /// The parsed declarations are released whenever nothing refers to them anymore, which limits the memory used for large modules.
+    bool streaming = false;
+
+    /// The optimization level, from 0 (no optimizations) to 3 (all optimizations, including aggressive inlining).
+    U32 optLevel = 0;
+
+    /// If set, the time spent in each optimization pass is reported after optimizing.
+    bool timePasses = false;
+
+    /// The kind of file that is produced, and the file it is written to.
+    /// If no file is set, a default name for the output kind is used.
+    OutputKind output = OutputKind::IR;
+    std::string outputFile;
+
+    /// The target that code is generated for, as an LLVM target triple. If this is empty, code is generated for the host.
+    std::string targetTriple;
+
+    /// The CPU that code is generated for, and a comma-separated list of features that are enabled (+feature) or disabled (-feature) on top of it.
+    /// The CPU "native" selects the CPU of the host together with each feature it supports.
+    /// Generated modules always use the data layout of the resulting target, since types are laid out according to it.
+    std::string targetCpu = "generic";
+    std::string targetFeatures;
+
+    /// The number of threads that native code is generated on.
+    /// If this is more than one, the module is split into a partition for each thread, and each partition is written to its own file.
+    U32 codegenThreads = 1;
+
+    /// If set, generated modules are cached as bitcode in this directory,
+    /// so that compiling a module that did not change skips everything up to code generation.
+    /// When the cache becomes larger than the maximum size, the entries that were used least recently are removed.
+    std::string cacheDirectory;
+    U64 cacheSize = 512 * 1024 * 1024;
+
+    /// If set, the total hits and misses of the cache are reported after compiling.
+    bool cacheStats = false;
+
+    /// If set, object files are compiled one function at a time, and each function's object is kept in the cache directory.
+    /// Only functions that changed since an earlier build are compiled again, and the output is a static archive of the objects.
+    bool incremental = false;
+
+    /// If set, programs that are run directly are compiled one function at a time, when each function is first called.
+    bool lazyJit = false;
+
+    /// If set, the lazy JIT first compiles each function without optimizations, and counts its calls and loop iterations.
+    /// Functions whose count reaches the threshold are optimized and compiled again in the background,
+    /// after which new calls to them use the optimized code.
+    bool tieredJit = false;
+    U32 tierThreshold = 1000;
 };
 
 struct DiagnosticConsumer;
@@ -0,0 +1,496 @@
+//--------------------------------------------------------------
+// Copyright © 2015 Rimmer Motzheim - All rights reserved
+//--------------------------------------------------------------
+
+#ifndef Tritium_Core_Hamt_h
+#define Tritium_Core_Hamt_h
+
+#include "types.h"
+#include "maybe.h"
+#include "mem.h"
+#include "hash.h"
+#include "array.h"
+
+namespace Tritium {
+
+/**
+ * Persistent map implemented as a hash array mapped trie.
+ * Each node covers 5 bits of the key hash and stores up to 32 entries or child nodes,
+ * so lookups take O(log32 n) steps.
+ *
+ * Nodes are reference counted and shared between copies of a map.
+ * Copying a map is O(1) and creates a snapshot: later changes to either map copy the nodes on the path they modify,
+ * leaving the other one unchanged. Nodes that are only used by a single map are modified in place.
+ *
+ * Pointers to values are only valid until the next modification of the map.
+ * New values are value-initialized. The reference counts are not atomic,
+ * so a map and its snapshots must only be used by one thread at a time.
+ */
+template<class Key, class T, class Allocator = HeapAllocator>
+struct PersistentMap {
+    struct Entry {
+        Key key;
+        T value;
+    };
+
+    PersistentMap() = default;
+    PersistentMap(const PersistentMap& m) : root(m.root), count(m.count) {retain(root);}
+    PersistentMap(PersistentMap&& m) : root(m.root), count(m.count) {m.root = nullptr; m.count = 0;}
+    ~PersistentMap() {release(root);}
+
+    PersistentMap& operator = (const PersistentMap& m) {
+        retain(m.root);
+        release(root);
+        root = m.root;
+        count = m.count;
+        return *this;
+    }
+
+    PersistentMap& operator = (PersistentMap&& m) {
+        ::swap(root, m.root);
+        ::swap(count, m.count);
+        return *this;
+    }
+
+    /// Returns a snapshot of the current contents of the map.
+    PersistentMap snapshot() const {
+        return *this;
+    }
+
+    Maybe<const T*> get(const Key& key) const {
+        auto h = hash(key);
+        auto n = root;
+        U32 shift = 0;
+        while(n) {
+            if(shift >= kHashBits) {
+                for(U32 i = 0; i < n->collisions; i++) {
+                    if(n->entries()[i].key == key) return Just((const T*)&n->entries()[i].value);
+                }
+                return Nothing();
+            }
+
+            auto bit = slotBit(h, shift);
+            if(n->dataMap & bit) {
+                auto& e = n->entries()[n->dataIndex(bit)];
+                if(e.key == key) return Just((const T*)&e.value);
+                return Nothing();
+            } else if(n->nodeMap & bit) {
+                n = n->children()[n->childIndex(bit)];
+                shift += kBitsPerLevel;
+            } else {
+                return Nothing();
+            }
+        }
+
+        return Nothing();
+    }
+
+    /**
+     * Adds an entry with the specified key to the map if it doesn't exist yet.
+     * @param key The key to add.
+     * @param out Will be set to the existing or created item data.
+     * @return True if an item already existed.
+     */
+    bool addGet(const Key& key, T*& out) {
+        bool existed = false;
+        root = insert(root, hash(key), key, 0, out, existed);
+        if(!existed) count++;
+        return existed;
+    }
+
+    /**
+     * Adds or replaces the entry with the specified key.
+     * @return True if an item already existed.
+     */
+    bool add(const Key& key, const T& data, bool overwrite = true) {
+        T* value;
+        auto existed = addGet(key, value);
+        if(!existed || overwrite) *value = data;
+        return existed;
+    }
+
+    /**
+     * Removes the element with the provided key, if any exists.
+     * @return True if an element was removed.
+     */
+    bool remove(const Key& key) {
+        bool removed = false;
+        root = erase(root, hash(key), key, 0, removed);
+        if(removed) count--;
+        return removed;
+    }
+
+    void clear() {
+        release(root);
+        root = nullptr;
+        count = 0;
+    }
+
+    Size size() const {
+        return count;
+    }
+
+    /// Returns true if both maps are the same snapshot.
+    bool sameAs(const PersistentMap& m) const {
+        return root == m.root;
+    }
+
+    /// Calls f(key, value) for each entry in the map, in hash order.
+    template<class F>
+    void walk(F&& f) const {
+        if(root) walkNode(root, 0, f);
+    }
+
+    /// Calls f(key, value&) for each entry in the map, making any shared nodes unique first.
+    template<class F>
+    void modify(F&& f) {
+        if(root) root = modifyNode(root, 0, f);
+    }
+
+private:
+    static const U32 kBitsPerLevel = 5;
+    static const U32 kHashBits = 32;
+
+    /**
+     * A trie node. This is followed in memory by its entries and then its children.
+     * Nodes at the maximum depth store all entries with the same hash as a single list instead.
+     */
+    struct Node {
+        U32 refs;
+        U32 dataMap;
+        U32 nodeMap;
+        U32 collisions;
+
+        U32 dataCount() const {return collisions ? collisions : (U32)countBits((U64)dataMap);}
+        U32 nodeCount() const {return (U32)countBits((U64)nodeMap);}
+        U32 dataIndex(U32 bit) const {return (U32)countBits((U64)(dataMap & (bit - 1)));}
+        U32 childIndex(U32 bit) const {return (U32)countBits((U64)(nodeMap & (bit - 1)));}
+
+        Entry* entries() {return (Entry*)(this + 1);}
+        Node** children() {return (Node**)((Byte*)(this + 1) + entrySize(dataCount()));}
+    };
+
+    static Size entrySize(U32 count) {
+        return (count * sizeof(Entry) + sizeof(Node*) - 1) / sizeof(Node*) * sizeof(Node*);
+    }
+
+    static U32 slotBit(U32 h, U32 shift) {
+        return U32(1) << ((h >> shift) & 31);
+    }
+
+    /// Nodes are allocated with room for a power of two of entries and children, so that most changes can be made in place.
+    static U32 slotCapacity(U32 count) {
+        return count <= 1 ? count : U32(1) << (findLastBit(count - 1) + 1);
+    }
+
+    /**
+     * Returns the allocation size of a node with the provided contents.
+     * A node whose contents changed in place may have a larger allocation than this, but never a smaller one.
+     */
+    static Size nodeSize(U32 dataCount, U32 nodeCount) {
+        return sizeof(Node) + entrySize(slotCapacity(dataCount)) + slotCapacity(nodeCount) * sizeof(Node*);
+    }
+
+    static Node* allocNode(U32 dataMap, U32 nodeMap, U32 collisions) {
+        auto dataCount = collisions ? collisions : (U32)countBits((U64)dataMap);
+        auto n = (Node*)Allocator::alloc(nodeSize(dataCount, (U32)countBits((U64)nodeMap)));
+        n->refs = 1;
+        n->dataMap = dataMap;
+        n->nodeMap = nodeMap;
+        n->collisions = collisions;
+        return n;
+    }
+
+    static void retain(Node* n) {
+        if(n) n->refs++;
+    }
+
+    static void release(Node* n) {
+        if(!n || --n->refs) return;
+
+        auto entries = n->entries();
+        for(U32 i = 0, c = n->dataCount(); i < c; i++) entries[i].~Entry();
+
+        auto children = n->children();
+        for(U32 i = 0, c = n->nodeCount(); i < c; i++) release(children[i]);
+
+        Allocator::free(n);
+    }
+
+    /**
+     * Builds a node from an existing one, with one entry or child added or removed.
+     * The new entry is value-initialized, and a new child is left for the caller to set.
+     * The reference to the old node is released.
+     * If the old node is only used by the caller, it is updated in place when the new contents fit in its allocation,
+     * and its contents are moved to a new node otherwise.
+     */
+    static Node* rebuild(Node* n, U32 dataMap, U32 nodeMap, U32 collisions, U32 skipEntry, U32 skipChild, U32 addEntry, U32 addChild, const Key* key) {
+        assert(skipEntry == U32(-1) || addEntry == U32(-1));
+
+        auto dataCount = n->dataCount();
+        auto nodeCount = n->nodeCount();
+
+        if(n->refs > 1) {
+            auto r = allocNode(dataMap, nodeMap, collisions);
+            auto src = n->entries();
+            auto dst = r->entries();
+            for(U32 i = 0, j = 0; i <= dataCount; i++) {
+                if(i == addEntry) new (dst + j++) Entry{*key, T()};
+                if(i < dataCount && i != skipEntry) new (dst + j++) Entry(src[i]);
+            }
+
+            auto srcChildren = n->children();
+            auto dstChildren = r->children();
+            for(U32 i = 0, j = 0; i <= nodeCount; i++) {
+                if(i == addChild) dstChildren[j++] = nullptr;
+                if(i < nodeCount && i != skipChild) {
+                    dstChildren[j++] = srcChildren[i];
+                    retain(srcChildren[i]);
+                }
+            }
+
+            release(n);
+            return r;
+        }
+
+        // The children are stored after the entries, so they are saved before the entries are moved.
+        Node* children[32];
+        U32 newNodeCount = 0;
+        auto srcChildren = n->children();
+        for(U32 i = 0; i <= nodeCount; i++) {
+            if(i == addChild) children[newNodeCount++] = nullptr;
+            if(i < nodeCount && i != skipChild) children[newNodeCount++] = srcChildren[i];
+        }
+
+        auto newDataCount = collisions ? collisions : (U32)countBits((U64)dataMap);
+        auto src = n->entries();
+        Node* r;
+        if(nodeSize(newDataCount, newNodeCount) <= nodeSize(dataCount, nodeCount)) {
+            r = n;
+            if(skipEntry != U32(-1)) {
+                src[skipEntry].~Entry();
+                for(U32 i = skipEntry + 1; i < dataCount; i++) {
+                    new (src + i - 1) Entry(std::move(src[i]));
+                    src[i].~Entry();
+                }
+            } else if(addEntry != U32(-1)) {
+                for(U32 i = dataCount; i > addEntry; i--) {
+                    new (src + i) Entry(std::move(src[i - 1]));
+                    src[i - 1].~Entry();
+                }
+                new (src + addEntry) Entry{*key, T()};
+            }
+
+            r->dataMap = dataMap;
+            r->nodeMap = nodeMap;
+            r->collisions = collisions;
+        } else {
+            r = allocNode(dataMap, nodeMap, collisions);
+            auto dst = r->entries();
+            for(U32 i = 0, j = 0; i <= dataCount; i++) {
+                if(i == addEntry) new (dst + j++) Entry{*key, T()};
+                if(i < dataCount) {
+                    if(i != skipEntry) new (dst + j++) Entry(std::move(src[i]));
+                    src[i].~Entry();
+                }
+            }
+
+            Allocator::free(n);
+        }
+
+        // The references to the remaining children are taken over by the new contents.
+        memcpy(r->children(), children, newNodeCount * sizeof(Node*));
+        return r;
+    }
+
+    /// Returns a node with the same contents that is only used by the caller.
+    static Node* unique(Node* n) {
+        if(n->refs == 1) return n;
+        return rebuild(n, n->dataMap, n->nodeMap, n->collisions, U32(-1), U32(-1), U32(-1), U32(-1), nullptr);
+    }
+
+    /// Creates a subtree containing an existing entry and a new one with a different key.
+    static Node* merge(const Entry& existing, U32 existingHash, const Key& key, U32 h, U32 shift, T*& out) {
+        if(shift >= kHashBits) {
+            auto n = allocNode(0, 0, 2);
+            new (n->entries()) Entry(existing);
+            new (n->entries() + 1) Entry{key, T()};
+            out = &n->entries()[1].value;
+            return n;
+        }
+
+        auto a = slotBit(existingHash, shift);
+        auto b = slotBit(h, shift);
+        if(a == b) {
+            auto n = allocNode(0, a, 0);
+            n->children()[0] = merge(existing, existingHash, key, h, shift + kBitsPerLevel, out);
+            return n;
+        }
+
+        auto n = allocNode(a | b, 0, 0);
+        auto first = a < b ? 0 : 1;
+        new (n->entries() + first) Entry(existing);
+        new (n->entries() + (1 - first)) Entry{key, T()};
+        out = &n->entries()[1 - first].value;
+        return n;
+    }
+
+    /// Inserts a key into the subtree, taking over the caller's reference to the node and returning the new one.
+    static Node* insert(Node* n, U32 h, const Key& key, U32 shift, T*& out, bool& existed) {
+        if(!n) {
+            n = allocNode(slotBit(h, shift), 0, 0);
+            new (n->entries()) Entry{key, T()};
+            out = &n->entries()->value;
+            return n;
+        }
+
+        if(shift >= kHashBits) {
+            for(U32 i = 0; i < n->collisions; i++) {
+                if(n->entries()[i].key == key) {
+                    n = unique(n);
+                    existed = true;
+                    out = &n->entries()[i].value;
+                    return n;
+                }
+            }
+
+            auto c = n->collisions;
+            n = rebuild(n, 0, 0, c + 1, U32(-1), U32(-1), c, U32(-1), &key);
+            out = &n->entries()[c].value;
+            return n;
+        }
+
+        auto bit = slotBit(h, shift);
+        if(n->dataMap & bit) {
+            auto index = n->dataIndex(bit);
+            auto& e = n->entries()[index];
+            if(e.key == key) {
+                n = unique(n);
+                existed = true;
+                out = &n->entries()[index].value;
+                return n;
+            }
+
+            // Replace the entry with a subtree containing both keys.
+            auto child = merge(e, hash(e.key), key, h, shift + kBitsPerLevel, out);
+            auto childIndex = n->childIndex(bit);
+            n = rebuild(n, n->dataMap & ~bit, n->nodeMap | bit, 0, index, U32(-1), U32(-1), childIndex, nullptr);
+            n->children()[childIndex] = child;
+            return n;
+        } else if(n->nodeMap & bit) {
+            n = unique(n);
+            auto& child = n->children()[n->childIndex(bit)];
+            child = insert(child, h, key, shift + kBitsPerLevel, out, existed);
+            return n;
+        } else {
+            auto index = n->dataIndex(bit);
+            n = rebuild(n, n->dataMap | bit, n->nodeMap, 0, U32(-1), U32(-1), index, U32(-1), &key);
+            out = &n->entries()[index].value;
+            return n;
+        }
+    }
+
+    /// Removes a key from the subtree, taking over the caller's reference to the node. Returns null if the subtree becomes empty.
+    static Node* erase(Node* n, U32 h, const Key& key, U32 shift, bool& removed) {
+        if(!n) return nullptr;
+
+        if(shift >= kHashBits) {
+            for(U32 i = 0; i < n->collisions; i++) {
+                if(n->entries()[i].key == key) {
+                    removed = true;
+                    if(n->collisions == 1) {
+                        release(n);
+                        return nullptr;
+                    }
+                    return rebuild(n, 0, 0, n->collisions - 1, i, U32(-1), U32(-1), U32(-1), nullptr);
+                }
+            }
+            return n;
+        }
+
+        auto bit = slotBit(h, shift);
+        if(n->dataMap & bit) {
+            auto index = n->dataIndex(bit);
+            if(!(n->entries()[index].key == key)) return n;
+
+            removed = true;
+            if(n->dataMap == bit && !n->nodeMap) {
+                release(n);
+                return nullptr;
+            }
+            return rebuild(n, n->dataMap & ~bit, n->nodeMap, 0, index, U32(-1), U32(-1), U32(-1), nullptr);
+        } else if(n->nodeMap & bit) {
+            auto childIndex = n->childIndex(bit);
+            auto child = n->children()[childIndex];
+
+            // Only copy the path if the key actually exists.
+            retain(child);
+            auto r = erase(child, h, key, shift + kBitsPerLevel, removed);
+            if(!removed) {
+                release(r);
+                return n;
+            }
+
+            n = unique(n);
+            release(n->children()[childIndex]);
+            if(r) {
+                n->children()[childIndex] = r;
+                return n;
+            }
+
+            n->children()[childIndex] = nullptr;
+            if(n->nodeMap == bit && !n->dataMap) {
+                release(n);
+                return nullptr;
+            }
+            return rebuild(n, n->dataMap, n->nodeMap & ~bit, 0, U32(-1), childIndex, U32(-1), U32(-1), nullptr);
+        }
+
+        return n;
+    }
+
+    template<class F>
+    static void walkNode(Node* n, U32 shift, F& f) {
+        auto entries = n->entries();
+        for(U32 i = 0, c = n->dataCount(); i < c; i++) {
+            f(entries[i].key, (const T&)entries[i].value);
+        }
+
+        auto children = n->children();
+        for(U32 i = 0, c = n->nodeCount(); i < c; i++) {
+            walkNode(children[i], shift + kBitsPerLevel, f);
+        }
+    }
+
+    template<class F>
+    static Node* modifyNode(Node* n, U32 shift, F& f) {
+        n = unique(n);
+        auto entries = n->entries();
+        for(U32 i = 0, c = n->dataCount(); i < c; i++) {
+            f(entries[i].key, entries[i].value);
+        }
+
+        auto children = n->children();
+        for(U32 i = 0, c = n->nodeCount(); i < c; i++) {
+            children[i] = modifyNode(children[i], shift + kBitsPerLevel, f);
+        }
+        return n;
+    }
+
+    Node* root = nullptr;
+    Size count = 0;
+};
+
+template<class K, class T, class A, class F>
+void walk(F f, const PersistentMap<K, T, A>& map) {
+    map.walk(f);
+}
+
+template<class K, class T, class A, class F>
+void modify(F f, PersistentMap<K, T, A>& map) {
+    map.modify(f);
+}
+
+} // namespace Tritium
+
+#endif // Tritium_Core_Hamt_h
@@ -174,7 +174,14 @@ struct Map : Allocator {
      * @return True if an item already existed.
      */
     bool addGet(const Key& key, T*& out) {
-        return add(key, out, false);
+        Size index;
+        if(auto found = search(key, index)) {
+            out = found->get();
+            return true;
+        } else {
+            out = map.create(index, key)->get();
+            return false;
+        }
     }
 
     /**
@@ -5,6 +5,10 @@
 #include <cstdlib>
 #include <cassert>
 #include <cstring>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <vector>
 #include "mem.h"
 
 namespace Tritium {
@@ -19,8 +23,13 @@ void StaticBuffer::init(Size maxSize) {
 #endif
 
     this->maxSize = maxSize;
-    this->usedSize = 0;
-    this->allocations = 0;
+
+    // Use slices that are large enough to make claiming them rare,
+    // but small enough that a number of threads can use the buffer without wasting most of it.
+    auto slice = maxSize / (kSliceCount * 4);
+    if(slice > 256 * 1024) slice = 256 * 1024;
+    sliceSize = slice / 16 * 16;
+    clear();
 }
 
 void* StaticBuffer::alloc(Size size) {
@@ -28,17 +37,76 @@ void* StaticBuffer::alloc(Size size) {
 
     // We align all allocations to 16 bytes, so we don't have to worry about SIMD alignment.
     size = (size + 15) / 16 * 16;
-    auto newSize = usedSize += size;
-    if(newSize > maxSize) {
+
+    // Large allocations and threads without a slice use the shared counter directly.
+    auto index = threadIndex();
+    if(index >= kSliceCount || size > sliceSize / 4) {
+        return allocShared(size);
+    }
+
+    auto& slice = slices[index];
+    if((Size)(slice.end - slice.current) < size) {
+        // The remainder of the current slice is wasted.
+        auto p = (Byte*)claim(sliceSize);
+        if(!p) return allocShared(size);
+
+        slice.current = p;
+        slice.end = p + sliceSize;
+    }
+
+    auto p = slice.current;
+    slice.current += size;
+
+    // Only this thread writes these, so they don't need an atomic read-modify-write.
+    slice.used.store(slice.used.load(std::memory_order_relaxed) + size, std::memory_order_relaxed);
+    slice.allocations.store(slice.allocations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    return p;
+}
+
+void* StaticBuffer::claim(Size size) {
+    auto newSize = claimedSize += size;
+    if(newSize > maxSize) return nullptr;
+
+    assert((newSize - size) % 16 == 0);
+    return (Byte*)data + newSize - size;
+}
+
+void* StaticBuffer::allocShared(Size size) {
+    sharedUsed += size;
+    sharedAllocations++;
+
+    auto p = claim(size);
+    if(!p) {
         assert("The static buffer has run out of space. You need to increase its size." == nullptr);
 
         // Allocate from the heap as a fallback.
         return malloc(size);
     }
+    return p;
+}
 
-    allocations++;
-    assert(newSize - size % 4 == 0);
-    return (Byte*)data + newSize - size;
+Size StaticBuffer::getUsed() {
+    Size used = sharedUsed.load(std::memory_order_relaxed);
+    for(auto& s : slices) used += s.used.load(std::memory_order_relaxed);
+    return used;
+}
+
+Size StaticBuffer::getAllocations() {
+    Size allocations = sharedAllocations.load(std::memory_order_relaxed);
+    for(auto& s : slices) allocations += s.allocations.load(std::memory_order_relaxed);
+    return allocations;
+}
+
+void StaticBuffer::clear() {
+    claimedSize = 0;
+    sharedUsed = 0;
+    sharedAllocations = 0;
+    for(auto& s : slices) {
+        s.current = nullptr;
+        s.end = nullptr;
+        s.used = 0;
+        s.allocations = 0;
+    }
 }
 
 void StaticBuffer::destroy() {
@@ -50,6 +118,113 @@ void StaticBuffer::destroy() {
     }
 }
 
+THREAD_LOCAL ScratchBuffer* ScratchBuffer::active = nullptr;
+
+ScratchBuffer::~ScratchBuffer() {
+    auto c = chunks;
+    while(c) {
+        auto next = c->next;
+        ::free(c);
+        c = next;
+    }
+}
+
+void* ScratchBuffer::alloc(Size size) {
+    size = (size + 15) / 16 * 16;
+    auto total = size + sizeof(Header);
+    if((Size)(end - current) < total) nextChunk(total);
+
+    auto header = (Header*)current;
+    header->size = size;
+    last = current;
+    current += total;
+
+    used += total;
+    if(used > peak) peak = used;
+    return header + 1;
+}
+
+void* ScratchBuffer::reAlloc(void* data, Size newSize) {
+    if(!data) return alloc(newSize);
+
+    auto header = (Header*)data - 1;
+    newSize = (newSize + 15) / 16 * 16;
+
+    // The last allocation can be resized in place if the chunk has enough space left.
+    if((Byte*)header == last && (Size)(end - (Byte*)data) >= newSize) {
+        used += newSize - header->size;
+        if(used > peak) peak = used;
+
+        header->size = newSize;
+        current = (Byte*)data + newSize;
+        return data;
+    }
+
+    auto p = alloc(newSize);
+    memcpy(p, data, header->size < newSize ? header->size : newSize);
+    return p;
+}
+
+void ScratchBuffer::free(void* data) {
+    if(!data) return;
+
+    // Only the last allocation can be reused directly; anything else is freed when its scope is released.
+    auto header = (Header*)data - 1;
+    if((Byte*)header == last) {
+        used -= header->size + sizeof(Header);
+        current = last;
+        last = nullptr;
+    }
+}
+
+void ScratchBuffer::release(Mark mark) {
+    if(mark.chunk) {
+        // Calculate the amount of memory freed in each chunk after the mark.
+        auto c = mark.chunk;
+        Size freed = 0;
+        if(c == chunk) {
+            freed = current - mark.current;
+        } else {
+            freed = c->end - mark.current;
+            for(c = c->next; c != chunk; c = c->next) freed += c->end - c->data();
+            freed += current - chunk->data();
+        }
+
+        used -= freed;
+        chunk = mark.chunk;
+        current = mark.current;
+        end = chunk->end;
+    } else if(chunks) {
+        used = 0;
+        chunk = chunks;
+        current = chunk->data();
+        end = chunk->end;
+    }
+
+    last = nullptr;
+}
+
+void ScratchBuffer::nextChunk(Size size) {
+    // Reuse the next chunk if it is large enough. Otherwise, a new one is inserted before it.
+    auto next = chunk ? chunk->next : chunks;
+    if(!next || (Size)(next->end - next->data()) < size) {
+        auto dataSize = size > chunkSize ? size : chunkSize;
+        auto c = (Chunk*)malloc(sizeof(Chunk) + dataSize);
+        c->end = c->data() + dataSize;
+        c->next = next;
+        if(chunk) chunk->next = c;
+        else chunks = c;
+        next = c;
+    }
+
+    // The remainder of the current chunk is counted as used until it is released.
+    if(chunk) used += end - current;
+
+    chunk = next;
+    current = chunk->data();
+    end = chunk->end;
+}
+
 } //namespace Tritium
 
 void* HeapAllocator::alloc(Size size) {return malloc(size);}
@@ -77,4 +252,76 @@ U32 findLastBit(U32 a) {
 	}
 	return c;
 #endif
-}
\ No newline at end of file
+}
+
+/*
+ * Thread indices are handed out and released under a lock, which is only taken when a thread first asks for its index and when it exits.
+ * Taking the lock also orders anything the previous owner of an index did before it exited before the accesses of the next owner.
+ * The free indices are kept in a heap, so that new threads take the lowest one and tables indexed by them stay small.
+ */
+static std::mutex threadLock;
+static ThreadExitListener* threadExitListeners = nullptr;
+static U32 nextThreadIndex = 0;
+
+static std::vector<U32>& freeThreadIndices() {
+    // Threads may exit while static objects are being destroyed, so this is never destroyed.
+    static auto indices = new std::vector<U32>;
+    return *indices;
+}
+
+static THREAD_LOCAL U32 currentThreadIndex = 0xffffffff;
+
+/// Releases the index of a thread when it exits.
+struct ThreadSlot {
+    U32 index = 0xffffffff;
+
+    ~ThreadSlot() {
+        std::lock_guard<std::mutex> lock{threadLock};
+        for(auto l = threadExitListeners; l; l = l->next) {
+            l->callback(l->context, index);
+        }
+
+        auto& indices = freeThreadIndices();
+        indices.push_back(index);
+        std::push_heap(indices.begin(), indices.end(), std::greater<U32>());
+        currentThreadIndex = kNoThreadIndex;
+    }
+};
+
+static thread_local ThreadSlot threadSlot;
+
+U32 threadIndex() {
+    if(currentThreadIndex == 0xffffffff) {
+        std::lock_guard<std::mutex> lock{threadLock};
+        auto& indices = freeThreadIndices();
+        if(indices.empty()) {
+            currentThreadIndex = nextThreadIndex++;
+        } else {
+            std::pop_heap(indices.begin(), indices.end(), std::greater<U32>());
+            currentThreadIndex = indices.back();
+            indices.pop_back();
+        }
+
+        // Accessing the slot registers its destructor for this thread.
+        threadSlot.index = currentThreadIndex;
+    }
+
+    return currentThreadIndex;
+}
+
+void addThreadExitListener(ThreadExitListener& listener) {
+    std::lock_guard<std::mutex> lock{threadLock};
+    listener.previous = nullptr;
+    listener.next = threadExitListeners;
+    if(threadExitListeners) threadExitListeners->previous = &listener;
+    threadExitListeners = &listener;
+}
+
+void removeThreadExitListener(ThreadExitListener& listener) {
+    std::lock_guard<std::mutex> lock{threadLock};
+    if(listener.previous) listener.previous->next = listener.next;
+    else threadExitListeners = listener.next;
+    if(listener.next) listener.next->previous = listener.previous;
+    listener.previous = nullptr;
+    listener.next = nullptr;
+}
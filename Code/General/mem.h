@@ -8,6 +8,7 @@
 
 #include "types.h"
 #include <atomic>
+#include <cassert>
 
 namespace Tritium {
 
@@ -15,8 +16,12 @@ namespace Tritium {
  * Provides permanent memory allocation.
  * The buffer cannot be resized, due to multithreading issues.
  * However, the memory pages are not mapped before they are used, so it is save to use large sizes.
+ * Each thread claims a slice of the buffer and allocates from it without synchronization,
+ * so that threads only contend when claiming a new slice.
  */
 struct StaticBuffer {
+    static const U32 kSliceCount = 64;
+
     StaticBuffer() = default;
     StaticBuffer(Size maxSize) {init(maxSize);}
     ~StaticBuffer() {destroy();}
@@ -32,19 +37,142 @@ struct StaticBuffer {
         return x;
     }
 
-    Size getUsed() {return usedSize;}
-    Size getAllocations() {return allocations;}
+    /// Returns the number of bytes allocated by all threads so far.
+    Size getUsed();
 
-    void clear() {
-        usedSize = 0;
-        allocations = 0;
-    }
+    /// Returns the number of allocations made by all threads so far.
+    Size getAllocations();
+
+    /// Resets the buffer. This must only be called while no other thread uses it.
+    void clear();
 
 private:
+    /**
+     * A range of the buffer that belongs to a single thread.
+     * The statistics are only written by that thread, but can be read by any thread.
+     * Slices are indexed by threadIndex(), so when a thread exits, the next thread that receives its index continues its slice.
+     */
+    struct alignas(64) Slice { // Keep each slice in its own cache line.
+        Byte* current;
+        Byte* end;
+        std::atomic_size_t used;
+        std::atomic_size_t allocations;
+    };
+
+    void* claim(Size size);
+    void* allocShared(Size size);
+
     void* data = 0;
     Size maxSize = 0;
-    std::atomic_size_t usedSize{0};
-    std::atomic_size_t allocations{0};
+    Size sliceSize = 0;
+    std::atomic_size_t claimedSize{0};
+
+    // Allocations that don't use a slice.
+    std::atomic_size_t sharedUsed{0};
+    std::atomic_size_t sharedAllocations{0};
+
+    Slice slices[kSliceCount] = {};
+};
+
+/**
+ * Provides temporary memory allocation with stack discipline.
+ * Memory is allocated by bumping a pointer, and freed all at once by releasing a mark that was taken earlier.
+ * Released chunks are kept for reuse, so that repeatedly allocating and releasing doesn't touch the heap.
+ */
+struct ScratchBuffer {
+    struct Chunk {
+        Chunk* next;
+        Byte* end;
+        Byte* data() {return (Byte*)(this + 1);}
+    };
+
+    struct Mark {
+        Chunk* chunk;
+        Byte* current;
+    };
+
+    ScratchBuffer(Size chunkSize = 64 * 1024) : chunkSize(chunkSize) {}
+    ~ScratchBuffer();
+
+    void* alloc(Size size);
+
+    /// Resizes an allocation. This is done in place if it was the last allocation in the buffer.
+    void* reAlloc(void* data, Size newSize);
+
+    /// Frees an allocation. The memory is only reused if it was the last allocation in the buffer.
+    void free(void* data);
+
+    /// Returns the current allocation position.
+    Mark mark() const {return {chunk, current};}
+
+    /// Frees everything that was allocated after the provided mark was taken.
+    void release(Mark mark);
+
+    /// Returns the largest number of bytes that were in use at the same time.
+    Size getPeak() const {return peak;}
+
+    /// The buffer used by ScratchAllocator on the current thread, if any.
+    static THREAD_LOCAL ScratchBuffer* active;
+
+private:
+    struct Header {
+        Size size;
+        Size pad; // Keeps allocations aligned to 16 bytes.
+    };
+
+    void nextChunk(Size size);
+
+    Chunk* chunks = nullptr;
+    Chunk* chunk = nullptr;
+    Byte* current = nullptr;
+    Byte* end = nullptr;
+    Byte* last = nullptr;
+    Size chunkSize;
+    Size used = 0;
+    Size peak = 0;
+};
+
+/**
+ * Allocator that uses the scratch buffer of the innermost ScratchScope on the current thread.
+ * Containers using it must not outlive their scope, and must only grow while no nested scope is active.
+ */
+struct ScratchAllocator {
+    static void* alloc(Size size) {
+        assert(ScratchBuffer::active && "ScratchAllocator used outside of a scratch scope.");
+        return ScratchBuffer::active->alloc(size);
+    }
+
+    static void* reAlloc(void* data, Size newSize) {
+        assert(ScratchBuffer::active && "ScratchAllocator used outside of a scratch scope.");
+        return ScratchBuffer::active->reAlloc(data, newSize);
+    }
+
+    static void free(void* data) {
+        if(ScratchBuffer::active) ScratchBuffer::active->free(data);
+    }
+};
+
+/**
+ * Makes a scratch buffer the one used by ScratchAllocator on the current thread,
+ * and releases everything that was allocated from it during the lifetime of the scope.
+ */
+struct ScratchScope {
+    ScratchScope(ScratchBuffer& buffer) : buffer(buffer), mark(buffer.mark()), previous(ScratchBuffer::active) {
+        ScratchBuffer::active = &buffer;
+    }
+
+    ~ScratchScope() {
+        buffer.release(mark);
+        ScratchBuffer::active = previous;
+    }
+
+    ScratchScope(const ScratchScope&) = delete;
+    ScratchScope& operator = (const ScratchScope&) = delete;
+
+private:
+    ScratchBuffer& buffer;
+    ScratchBuffer::Mark mark;
+    ScratchBuffer* previous;
 };
 
 } //namespace Tritium
@@ -60,4 +188,34 @@ struct HeapAllocator {
 
 U32 findLastBit(U32 a);
 
+/**
+ * Returns a small index for the calling thread, which is unique among the threads that are running.
+ * Each thread receives the lowest free index when it first calls this, and releases it again when it exits.
+ * This can be used to give each running thread its own slot in a fixed-size table.
+ * Threads that call this while exiting, after their index was released, receive kNoThreadIndex.
+ */
+U32 threadIndex();
+
+static const U32 kNoThreadIndex = 0xfffffffe;
+
+/**
+ * Receives a callback when a thread exits, before its index is released and can be given to another thread.
+ * The callback runs on the exiting thread, so it can hand back data in the slot of that thread without synchronizing with it.
+ * A listener must stay at the same address and be removed before it is destroyed.
+ */
+struct ThreadExitListener {
+    ThreadExitListener(void (*callback)(void* context, U32 index), void* context) : callback(callback), context(context) {}
+
+    void (*callback)(void* context, U32 index);
+    void* context;
+    ThreadExitListener* previous = nullptr;
+    ThreadExitListener* next = nullptr;
+};
+
+/// Registers a listener for each thread that exits from now on.
+void addThreadExitListener(ThreadExitListener& listener);
+
+/// Removes a listener. Once this returns, no thread is running its callback anymore.
+void removeThreadExitListener(ThreadExitListener& listener);
+
 #endif // Tritium_Mem_StaticBuffer_h
\ No newline at end of file
@@ -260,6 +260,277 @@ private:
     U32 mCount = 0;
 };
 
+/**
+ * Defines a pool allocator which can be used from multiple threads at the same time.
+ * Each thread allocates from and frees to its own cache of blocks, without any synchronization.
+ * When a cache runs empty or grows too large, a whole batch of blocks is moved between it and a global lock-free list,
+ * so that shared state is only touched once per batch instead of once per allocation.
+ * Caches are indexed by threadIndex(). When a thread exits, its cache is moved to the global list before the index is reused.
+ * Threads with an index beyond the number of cache slots use the global list directly.
+ */
+template<typename Allocator>
+struct BasePool_Shared {
+    static const U32 kCacheCount = 64;
+    static const U32 kBatchSize = 32;
+
+    struct Node {
+        Node* next;
+    };
+
+    /// The first node of each batch in the global list also links the batches together.
+    struct Batch : Node {
+        Batch* nextBatch;
+        U32 count;
+    };
+
+    struct Block {
+        Block* next;
+        void* pad; // To allow simd types in pools.
+    };
+
+    // Keep each cache in its own cache line.
+    struct alignas(64) Cache {
+        Node* free;
+        U32 count;
+    };
+
+    /**
+     * Creates a shared pool allocator.
+     * @param blockSize The size of a single object in the pool.
+     * @param count The initial number of objects in the pool.
+     */
+    BasePool_Shared(Size blockSize, Size count) {
+        // Each free block must be able to store a batch header.
+        if(blockSize < sizeof(Batch)) blockSize = sizeof(Batch);
+        mBlockSize = (U32)((blockSize + sizeof(void*) - 1) / sizeof(void*) * sizeof(void*));
+        memset(mCaches, 0, sizeof(mCaches));
+
+        if(count) {
+            auto batch = commit((U32)count);
+            pushBatches(batch, batch);
+        }
+
+        addThreadExitListener(mExitListener);
+    }
+
+    /**
+     * Frees all memory that was allocated by the pool.
+     * This must only be called once no other thread uses the pool.
+     * Since this doesn't call any destructors,
+     * you need to make sure to free all allocated non-POD objects manually.
+     */
+    ~BasePool_Shared() {
+        removeThreadExitListener(mExitListener);
+
+        auto b = mBlocks.load(std::memory_order_acquire);
+        while(b) {
+            auto p = b;
+            b = b->next;
+            Allocator::free(p);
+        }
+    }
+
+    /**
+     * Allocates an object of type T and calls its constructor.
+     * The block size of this pool must be >= the size of T.
+     */
+    template<typename T, typename... P>
+    T* create(Size blockSize, P&&... p) {
+        assert(sizeof(T) <= blockSize);
+        auto obj = (T*)alloc(blockSize);
+        new (obj) T(forward<P>(p)...);
+        return obj;
+    }
+
+    /// Calls the provided object's destructor and frees its memory.
+    template<typename T>
+    void destroy(T* obj) {
+        obj->~T();
+        free(obj);
+    }
+
+    /**
+     * Allocates a block of memory.
+     * @param blockSize The size of a single block.
+     * This must be the same as the size that was provided to the constructor.
+     */
+    void* alloc(Size blockSize) {
+        assert(blockSize <= mBlockSize);
+        Node* node;
+
+        auto index = threadIndex();
+        if(index < kCacheCount) {
+            auto& cache = mCaches[index];
+            if(!cache.free) {
+                auto batch = takeBatch();
+                cache.free = batch;
+                cache.count = batch->count;
+            }
+
+            node = cache.free;
+            cache.free = node->next;
+            cache.count--;
+        } else {
+            // Take the first node and return the rest of the batch.
+            auto batch = takeBatch();
+            node = batch;
+            if(batch->count > 1) {
+                auto rest = (Batch*)batch->next;
+                rest->count = batch->count - 1;
+                pushBatches(rest, rest);
+            }
+        }
+
+#ifdef _DEBUG
+        memset(node, 0xcdcdcdcd, blockSize);
+#endif
+        return node;
+    }
+
+    /**
+     * Marks the block of memory at the provided address as being free.
+     * The block may be freed by a different thread than the one that allocated it.
+     * @param obj The address to free. This must be an address that was returned by alloc().
+     */
+    void free(void* obj) {
+        auto node = (Node*)obj;
+        auto index = threadIndex();
+        if(index < kCacheCount) {
+            auto& cache = mCaches[index];
+            node->next = cache.free;
+            cache.free = node;
+            cache.count++;
+
+            // Move a batch to the global list, but keep enough blocks to handle a few allocations without refilling.
+            if(cache.count >= kBatchSize * 2) {
+                auto batch = (Batch*)cache.free;
+                Node* last = batch;
+                for(U32 i = 1; i < kBatchSize; i++) last = last->next;
+
+                cache.free = last->next;
+                cache.count -= kBatchSize;
+                last->next = nullptr;
+                batch->count = kBatchSize;
+                pushBatches(batch, batch);
+            }
+        } else {
+            auto batch = (Batch*)node;
+            batch->next = nullptr;
+            batch->count = 1;
+            pushBatches(batch, batch);
+        }
+    }
+
+private:
+    /*
+     * The global list is a lock-free stack of batches.
+     * To prevent the ABA problem, the head pointer is stored together with a tag in its upper 16 bits,
+     * which is incremented on each change. Pointers are assumed to fit in the lower 48 bits.
+     * Memory is never returned to the allocator while the pool exists,
+     * so reading the next pointer of a batch that was just taken by another thread is safe;
+     * the changed tag then causes the exchange to fail.
+     */
+    static const U64 kPointerMask = (U64(1) << 48) - 1;
+
+    static Batch* headPointer(U64 head) {return (Batch*)(head & kPointerMask);}
+    static U64 makeHead(Batch* b, U64 previous) {
+        assert(((U64)b & ~kPointerMask) == 0);
+        return (U64)b | ((previous & ~kPointerMask) + (U64(1) << 48));
+    }
+
+    /// Moves the cache of an exiting thread to the global list, so that its blocks can be used by other threads.
+    static void flushCache(void* pool, U32 index) {
+        auto self = (BasePool_Shared*)pool;
+        if(index >= kCacheCount) return;
+
+        auto& cache = self->mCaches[index];
+        if(cache.free) {
+            auto batch = (Batch*)cache.free;
+            batch->count = cache.count;
+            self->pushBatches(batch, batch);
+        }
+
+        cache.free = nullptr;
+        cache.count = 0;
+    }
+
+    /// Pushes a list of batches linked through nextBatch onto the global list.
+    void pushBatches(Batch* first, Batch* last) {
+        auto head = mBatches.load(std::memory_order_relaxed);
+        do {
+            last->nextBatch = headPointer(head);
+        } while(!mBatches.compare_exchange_weak(head, makeHead(first, head), std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    /// Takes a batch from the global list, or commits new memory if it is empty.
+    Batch* takeBatch() {
+        auto head = mBatches.load(std::memory_order_acquire);
+        while(auto b = headPointer(head)) {
+            if(mBatches.compare_exchange_weak(head, makeHead(b->nextBatch, head), std::memory_order_acquire, std::memory_order_acquire)) {
+                return b;
+            }
+        }
+
+        // Allocate a memory block of about the current pool size, keep one batch and share the rest.
+        auto first = commit(mCount.load(std::memory_order_relaxed));
+        if(first->nextBatch) {
+            auto last = first->nextBatch;
+            while(last->nextBatch) last = last->nextBatch;
+            pushBatches(first->nextBatch, last);
+        }
+        return first;
+    }
+
+    /**
+     * Commits a memory range and splits it into batches.
+     * @param count The minimum number of blocks to allocate.
+     * @return The first batch in a list of batches linked through nextBatch.
+     */
+    Batch* commit(U32 count) {
+        count = (count + kBatchSize - 1) / kBatchSize * kBatchSize;
+        if(count < kBatchSize * 2) count = kBatchSize * 2;
+
+        auto b = (Block*)Allocator::alloc(sizeof(Block) + mBlockSize * count);
+        mCount += count;
+
+        // Add the block to the list. Blocks are only removed when the pool is destroyed.
+        auto head = mBlocks.load(std::memory_order_relaxed);
+        do {
+            b->next = head;
+        } while(!mBlocks.compare_exchange_weak(head, b, std::memory_order_release, std::memory_order_relaxed));
+
+        // Create a free list for each batch.
+        auto data = (Byte*)(b + 1);
+        Batch* previous = nullptr;
+        for(U32 i = 0; i < count; i += kBatchSize) {
+            auto batch = (Batch*)(data + i * mBlockSize);
+            Node* node = batch;
+            for(U32 j = 1; j < kBatchSize; j++) {
+                auto next = (Node*)((Byte*)node + mBlockSize);
+                node->next = next;
+                node = next;
+            }
+            node->next = nullptr;
+
+            batch->count = kBatchSize;
+            batch->nextBatch = nullptr;
+            if(previous) previous->nextBatch = batch;
+            previous = batch;
+        }
+
+        return (Batch*)data;
+    }
+
+    //---------------------------------------------------------
+
+    Cache mCaches[kCacheCount];
+    std::atomic<U64> mBatches{0};
+    std::atomic<Block*> mBlocks{nullptr};
+    std::atomic<U32> mCount{0};
+    U32 mBlockSize;
+    ThreadExitListener mExitListener{flushCache, this};
+};
+
 /**
  * Defines a pool allocator that allocates objects of a pre-determined type.
  */
@@ -331,6 +602,10 @@ using Pool = Pool_Object<T, BasePool_Alloc<Allocator>>;
 template<typename Allocator = HeapAllocator>
 using BlockPool = Pool_Block<BasePool_Alloc<Allocator>>;
 
+/// A pool of objects that can be allocated and freed from any thread.
+template<typename T, typename Allocator = HeapAllocator>
+using SharedPool = Pool_Object<T, BasePool_Shared<Allocator>>;
+
 /**
  * A pool that uses fixed-size blocks to provide O(1) object retrieval by index.
  * The pool uses paging to minimize the amount of memory wasted on unused objects,
@@ -143,6 +143,14 @@ struct resultOf<F(Args...)> {
     typedef decltype(declVal<F>()(declVal<Args>()...)) type;
 };
 
+/**
+ * Defines if objects of a type can be moved to a different address by copying their bytes,
+ * without calling a move constructor or destructor.
+ * Containers use this to move elements with memmove or realloc instead of one at a time.
+ * This is true for trivially copyable types, and can be specialized for other types that don't point into themselves.
+ */
+template<class T> struct isTriviallyRelocatable : integralConstant<bool, __is_trivially_copyable(T)> {};
+
 template<class T1, class T2> struct isSame : falseConstant {};
 template<class T> struct isSame<T, T> : trueConstant {};
 
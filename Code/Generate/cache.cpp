@@ -0,0 +1,189 @@
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#define __STDC_LIMIT_MACROS
+
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/Support/Chrono.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/Process.h>
+#include "cache.h"
+#include "emit.h"
+
+using namespace llvm;
+
+namespace athena {
+namespace gen {
+
+// This has to be changed whenever the generated code changes for the same input,
+// since entries that were created by an older compiler would be used otherwise.
+static const char* cacheFormat = "athena-cache-1";
+
+void markUsed(const std::string& path) {
+	int file;
+	if(!sys::fs::openFileForRead(path, file)) {
+		sys::fs::setLastModificationAndAccessTime(file, sys::toTimePoint(time(nullptr)));
+		sys::Process::SafelyCloseFileDescriptor(file);
+	}
+}
+
+std::string ModuleCache::getKey(const std::string& source, const CompileSettings& settings, const llvm::Module& target, bool withThunk) {
+	MD5 hash;
+	auto add = [&](StringRef data) {
+		// Each part is prefixed by its length, so that different splits of the same data produce different keys.
+		hash.update(std::to_string(data.size()));
+		hash.update(":");
+		hash.update(data);
+	};
+
+	add(cacheFormat);
+	add(LLVM_VERSION_STRING);
+	add(target.getTargetTriple());
+	add(target.getDataLayoutStr());
+	add(source);
+
+	// The optimizer generates different code for each CPU, and the host CPU may change between compilations.
+	add(getTargetCpu(settings));
+	add(getTargetFeatures(settings));
+
+	add(std::to_string(settings.optLevel));
+
+	// These settings change which declarations are resolved and in which order, which affects the generated module.
+	add(std::to_string(settings.entryPoints.size()));
+	for(auto& entry : settings.entryPoints) add(entry);
+	add(settings.streaming ? "streaming" : "");
+
+	// Partitioned builds optimize each partition separately, so their modules are stored before optimizing.
+	add(settings.codegenThreads > 1 && settings.output != OutputKind::IR ? "partitioned" : "whole");
+	add(withThunk ? "thunk" : "");
+
+	MD5::MD5Result result;
+	hash.final(result);
+
+	SmallString<32> string;
+	MD5::stringifyResult(result, string);
+	return string.str().str();
+}
+
+std::unique_ptr<llvm::Module> ModuleCache::load(const std::string& key, llvm::LLVMContext& context) {
+	auto path = getPath(key);
+	auto buffer = MemoryBuffer::getFile(path);
+	if(!buffer) {
+		stats.misses++;
+		return nullptr;
+	}
+
+	auto module = parseBitcodeFile((*buffer)->getMemBufferRef(), context);
+	if(!module) {
+		// Entries that cannot be read are replaced when the module is stored again.
+		consumeError(module.takeError());
+		stats.misses++;
+		return nullptr;
+	}
+
+	markUsed(path);
+	stats.hits++;
+	return std::move(*module);
+}
+
+bool ModuleCache::store(const std::string& key, const llvm::Module& module, std::string& error) {
+	if(auto code = sys::fs::create_directories(directory)) {
+		error = "cannot create the cache directory '" + directory + "': " + code.message();
+		return false;
+	}
+
+	// The entry is written to a temporary file first,
+	// so that other compilations never see a partially written entry.
+	int file;
+	SmallString<128> tempPath;
+	if(auto code = sys::fs::createUniqueFile(directory + "/%%%%%%%%.tmp", file, tempPath)) {
+		error = "cannot create a cache entry: " + code.message();
+		return false;
+	}
+
+	{
+		raw_fd_ostream out{file, true};
+		WriteBitcodeToFile(&module, out);
+	}
+
+	if(auto code = sys::fs::rename(tempPath, getPath(key))) {
+		sys::fs::remove(tempPath);
+		error = "cannot create a cache entry: " + code.message();
+		return false;
+	}
+
+	return true;
+}
+
+void ModuleCache::evict() {
+	struct Entry {
+		std::string path;
+		sys::TimePoint<> lastUse;
+		U64 size;
+	};
+
+	std::vector<Entry> entries;
+	U64 totalSize = 0;
+
+	std::error_code code;
+	for(sys::fs::directory_iterator it{directory, code}, end; it != end && !code; it.increment(code)) {
+		// Besides modules, the cache contains the function objects of incremental builds.
+		auto& path = it->path();
+		if(!StringRef{path}.endswith(".bc") && !StringRef{path}.endswith(".o")) continue;
+
+		sys::fs::file_status status;
+		if(sys::fs::status(path, status)) continue;
+
+		entries.push_back(Entry{path, status.getLastModificationTime(), status.getSize()});
+		totalSize += status.getSize();
+	}
+
+	if(totalSize <= maxSize) return;
+
+	std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) {return a.lastUse < b.lastUse;});
+	for(auto& entry : entries) {
+		if(totalSize <= maxSize) break;
+		if(!sys::fs::remove(entry.path)) {
+			totalSize -= entry.size;
+			stats.evictions++;
+		}
+	}
+}
+
+CacheStats ModuleCache::updateStats() {
+	// The statistics are not locked, so concurrent compilations may lose some of their updates.
+	auto path = directory + "/stats";
+	CacheStats total;
+	{
+		std::ifstream file{path};
+		if(file) file >> total.hits >> total.misses >> total.evictions;
+		if(!file) total = CacheStats{};
+	}
+
+	total.hits += stats.hits;
+	total.misses += stats.misses;
+	total.evictions += stats.evictions;
+	stats = CacheStats{};
+
+	if(!sys::fs::create_directories(directory)) {
+		std::ofstream file{path};
+		file << total.hits << ' ' << total.misses << ' ' << total.evictions << '\n';
+	}
+	return total;
+}
+
+void printStats(const CacheStats& stats, llvm::raw_ostream& out) {
+	auto lookups = stats.hits + stats.misses;
+	out << "cache hits: " << stats.hits << ", misses: " << stats.misses << ", evictions: " << stats.evictions;
+	if(lookups) out << " (" << (stats.hits * 100 / lookups) << "% hit rate)";
+	out << '\n';
+}
+
+}} // namespace athena::gen
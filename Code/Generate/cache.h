@@ -0,0 +1,65 @@
+#ifndef Athena_Generate_cache_h
+#define Athena_Generate_cache_h
+
+#include <memory>
+#include <llvm/IR/Module.h>
+#include <llvm/Support/raw_ostream.h>
+#include "../General/compiler.h"
+
+namespace athena {
+namespace gen {
+
+/// Statistics about the use of a module cache, which are kept in the cache directory across compilations.
+struct CacheStats {
+	U64 hits = 0;
+	U64 misses = 0;
+	U64 evictions = 0;
+};
+
+/// Marks a file in a cache directory as used.
+/// Entries are evicted based on when they were last used, which is tracked through their modification time.
+void markUsed(const std::string& path);
+
+/**
+ * Stores generated modules as bitcode in a directory, so that compiling an unchanged module only has to load it.
+ * Each module is keyed by a hash of everything that affects the generated code:
+ * the source, the settings that change code generation, the target and the compiler version.
+ * When the total size of the cache exceeds its limit, the entries that were used least recently are removed.
+ */
+struct ModuleCache {
+	ModuleCache(const std::string& directory, U64 maxSize) : directory(directory), maxSize(maxSize) {}
+
+	/// Returns the cache key for a module with the provided source,
+	/// which is generated into a module that has the target and data layout of the provided one.
+	/// Modules that are run directly also contain an entry thunk, so they are cached separately.
+	std::string getKey(const std::string& source, const CompileSettings& settings, const llvm::Module& target, bool withThunk);
+
+	/// Loads the module with the provided key into the context.
+	/// Returns null if the cache has no valid entry for the key.
+	std::unique_ptr<llvm::Module> load(const std::string& key, llvm::LLVMContext& context);
+
+	/// Stores the module with the provided key, replacing any existing entry.
+	/// Returns false and sets the error message if the entry could not be written.
+	bool store(const std::string& key, const llvm::Module& module, std::string& error);
+
+	/// Removes the least recently used entries until the cache is within its size limit.
+	/// This includes the function objects of incremental builds, which are kept in the same directory.
+	void evict();
+
+	/// Adds the statistics for this compilation to the ones stored in the cache directory, and returns the total.
+	CacheStats updateStats();
+
+private:
+	std::string getPath(const std::string& key) {return directory + "/" + key + ".bc";}
+
+	std::string directory;
+	U64 maxSize;
+	CacheStats stats;
+};
+
+/// Prints cache statistics in a human-readable form.
+void printStats(const CacheStats& stats, llvm::raw_ostream& out);
+
+}} // namespace athena::gen
+
+#endif // Athena_Generate_cache_h
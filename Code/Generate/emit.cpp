@@ -0,0 +1,186 @@
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#define __STDC_LIMIT_MACROS
+
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/ADT/Triple.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/Support/TargetRegistry.h>
+#include <llvm/Support/TargetSelect.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Host.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Target/TargetOptions.h>
+#include <llvm/Transforms/Utils/SplitModule.h>
+#include "emit.h"
+#include "optimize.h"
+
+using namespace llvm;
+
+namespace athena {
+namespace gen {
+
+CodeGenOpt::Level getCodeGenLevel(const CompileSettings& settings) {
+	switch(settings.optLevel) {
+		case 0: return CodeGenOpt::None;
+		case 1: return CodeGenOpt::Less;
+		case 2: return CodeGenOpt::Default;
+		default: return CodeGenOpt::Aggressive;
+	}
+}
+
+std::string getTargetTriple(const CompileSettings& settings) {
+	return Triple::normalize(settings.targetTriple.empty() ? LLVM_HOST_TRIPLE : settings.targetTriple);
+}
+
+std::string getTargetCpu(const CompileSettings& settings) {
+	return settings.targetCpu == "native" ? sys::getHostCPUName().str() : settings.targetCpu;
+}
+
+std::string getTargetFeatures(const CompileSettings& settings) {
+	std::vector<std::string> features;
+	if(settings.targetCpu == "native") {
+		StringMap<bool> hostFeatures;
+		if(sys::getHostCPUFeatures(hostFeatures)) {
+			for(auto& feature : hostFeatures) {
+				features.push_back((feature.second ? "+" : "-") + feature.first().str());
+			}
+
+			// The map is unordered, while the same features should always produce the same string.
+			std::sort(features.begin(), features.end());
+		}
+	}
+
+	// Explicit features come last, so that they override the ones of the host.
+	if(!settings.targetFeatures.empty()) features.push_back(settings.targetFeatures);
+	return join(features.begin(), features.end(), ",");
+}
+
+void initTargets() {
+	static std::once_flag initialized;
+	std::call_once(initialized, [] {
+		InitializeNativeTarget();
+		InitializeNativeTargetAsmPrinter();
+	});
+}
+
+TargetMachine* createTargetMachine(const CompileSettings& settings, std::string& error) {
+	auto triple = getTargetTriple(settings);
+	if(settings.targetCpu == "native" && triple != getTargetTriple(CompileSettings{})) {
+		error = "the native CPU can only be used when generating code for the host";
+		return nullptr;
+	}
+
+	auto target = TargetRegistry::lookupTarget(triple, error);
+	if(!target) return nullptr;
+
+	// Generated code is position independent, so that it can be linked into both executables and shared libraries.
+	TargetOptions options;
+	auto machine = target->createTargetMachine(triple, getTargetCpu(settings), getTargetFeatures(settings), options, Optional<Reloc::Model>(Reloc::PIC_));
+	if(!machine) {
+		error = "cannot create a target machine for " + triple;
+		return nullptr;
+	}
+
+	machine->setOptLevel(getCodeGenLevel(settings));
+	return machine;
+}
+
+bool emitFile(llvm::Module& module, TargetMachine& target, const std::string& file, OutputKind kind, std::string& error) {
+	assert(kind == OutputKind::Object || kind == OutputKind::Assembly);
+
+	std::error_code code;
+	raw_fd_ostream out{file, code, sys::fs::F_None};
+	if(code) {
+		error = "cannot open '" + file + "': " + code.message();
+		return false;
+	}
+
+	auto type = kind == OutputKind::Object ? TargetMachine::CGFT_ObjectFile : TargetMachine::CGFT_AssemblyFile;
+
+	legacy::PassManager passes;
+	if(target.addPassesToEmitFile(passes, out, type)) {
+		error = "the target cannot emit this file type";
+		return false;
+	}
+
+	passes.run(module);
+	out.flush();
+	return true;
+}
+
+std::string getPartitionFile(const std::string& file, U32 index) {
+	auto dot = file.find_last_of('.');
+	auto slash = file.find_last_of("/\\");
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash)) dot = file.size();
+	return file.substr(0, dot) + '.' + std::to_string(index) + file.substr(dot);
+}
+
+/// The state of a single partition, which is only used by the thread that compiles it.
+struct Partition {
+	std::string bitcode;
+	std::string file;
+	std::string error;
+	bool success = false;
+};
+
+static void compilePartition(Partition& partition, const CompileSettings& settings) {
+	LLVMContext context;
+	auto module = parseBitcodeFile(MemoryBufferRef{partition.bitcode, partition.file}, context);
+	if(!module) {
+		partition.error = "cannot load the partition for '" + partition.file + "'";
+		consumeError(module.takeError());
+		return;
+	}
+
+	// Target machines are not thread safe, so each partition creates its own from the targets registered before.
+	std::unique_ptr<TargetMachine> target{createTargetMachine(settings, partition.error)};
+	if(!target) return;
+
+	optimize(**module, *target, settings);
+	partition.success = emitFile(**module, *target, partition.file, settings.output, partition.error);
+}
+
+bool emitPartitions(std::unique_ptr<llvm::Module> module, const CompileSettings& settings, U32 count, const std::string& file, std::string& error) {
+	// Pass timing uses global state, so it is not supported while compiling in parallel.
+	auto partitionSettings = settings;
+	partitionSettings.timePasses = false;
+
+	// Registering the target is not thread safe, so it is done before starting any threads.
+	initTargets();
+
+	// Each partition is serialized on this thread, since the parts still share the original context.
+	std::vector<Partition> partitions;
+	SplitModule(std::move(module), count, [&](std::unique_ptr<llvm::Module> part) {
+		partitions.emplace_back();
+		auto& partition = partitions.back();
+		partition.file = getPartitionFile(file, (U32)partitions.size() - 1);
+
+		raw_string_ostream stream{partition.bitcode};
+		WriteBitcodeToFile(part.get(), stream);
+	});
+
+	std::vector<std::thread> threads;
+	for(auto& partition : partitions) {
+		threads.emplace_back([&partition, &partitionSettings] {compilePartition(partition, partitionSettings);});
+	}
+
+	for(auto& thread : threads) thread.join();
+
+	for(auto& partition : partitions) {
+		if(!partition.success) {
+			error = partition.error;
+			return false;
+		}
+	}
+	return true;
+}
+
+}} // namespace athena::gen
@@ -0,0 +1,54 @@
+#ifndef Athena_Generate_emit_h
+#define Athena_Generate_emit_h
+
+#include <memory>
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include "../General/compiler.h"
+
+namespace athena {
+namespace gen {
+
+/// Returns the code generation level that corresponds to the optimization level in the provided settings.
+llvm::CodeGenOpt::Level getCodeGenLevel(const CompileSettings& settings);
+
+/// Returns the normalized target triple that code is generated for, which is the host unless the settings select a different one.
+std::string getTargetTriple(const CompileSettings& settings);
+
+/// Returns the CPU that code is generated for, where "native" is replaced by the host CPU.
+std::string getTargetCpu(const CompileSettings& settings);
+
+/// Returns the features that code is generated with, as a comma-separated list.
+/// For the native CPU this contains each feature of the host, followed by the features from the settings.
+std::string getTargetFeatures(const CompileSettings& settings);
+
+/// Registers the targets that code can be generated for. This only has an effect the first time it is called.
+/// Registering targets is not thread safe in LLVM, so this must be called before any thread uses the targets.
+void initTargets();
+
+/// Creates a target machine that generates code for the target, CPU and features in the provided settings.
+/// Only the targets that are registered by initTargets() are available, which are the ones for the host architecture.
+/// Returns null and sets the error message if the target is not available.
+llvm::TargetMachine* createTargetMachine(const CompileSettings& settings, std::string& error);
+
+/// Writes the provided module as native code to a file, as either an object file or assembly.
+/// The module must use the data layout of the target machine.
+/// Returns false and sets the error message if the file could not be written.
+bool emitFile(llvm::Module& module, llvm::TargetMachine& target, const std::string& file, OutputKind kind, std::string& error);
+
+/// Returns the name of the file that the partition with the provided index is written to.
+/// The index is inserted before the extension, so that out.o becomes out.0.o.
+std::string getPartitionFile(const std::string& file, U32 index);
+
+/**
+ * Splits the module into the provided number of partitions by function, and optimizes and generates native code
+ * for each partition on its own thread. Each partition is written to its own file, as named by getPartitionFile.
+ * LLVM contexts cannot be shared between threads, so each partition is moved into a new context through bitcode.
+ * Since partitions are optimized separately, functions are only inlined into callers within the same partition.
+ * Returns false and sets the error message if any partition could not be written.
+ */
+bool emitPartitions(std::unique_ptr<llvm::Module> module, const CompileSettings& settings, U32 count, const std::string& file, std::string& error);
+
+}} // namespace athena::gen
+
+#endif // Athena_Generate_emit_h
@@ -12,32 +12,55 @@ namespace athena {
 namespace gen {
 
 Generator::Generator(ast::CompileContext& ccontext, llvm::LLVMContext& context, llvm::Module& target) :
-	context(context), module(target), builder(context), ccontext(ccontext) {}
+	context(context), module(&target), builder(context), ccontext(ccontext) {}
 
 Module* Generator::generate(resolve::Module& module) {
+	// If the program has entry points, only those are generated directly.
+	// Any functions they call are generated lazily.
+	auto& entries = ccontext.settings.entryPoints;
+	if(entries.size()) {
+		for(auto& entry : entries) {
+			if(auto f = module.functions.get(ccontext.addUnqualifiedName(entry))) {
+				for(auto fn = *f.force(); fn; fn = fn->sibling) {
+					if(!fn->codegen && !resolve::isGeneric(fn)) genFunctionDecl(*fn);
+				}
+			}
+		}
+
+		return this->module;
+	}
+
+	// Generic functions cannot be generated directly.
+	// Their instances are generated lazily when they are called.
 	walk([=](Id name, resolve::FunctionDecl* f) {
-		if(!f->codegen) genFunctionDecl(*f);
+		for(; f; f = f->sibling) {
+			if(!f->codegen && !resolve::isGeneric(f)) genFunctionDecl(*f);
+		}
 	}, module.functions);
 
-	return &this->module;
+	return this->module;
 }
 
-Function* Generator::genFunctionDecl(resolve::FunctionDecl& function) {
+FunctionType* Generator::genFunctionType(resolve::FunctionDecl& function) {
 	auto argCount = function.arguments.size();
 	auto argTypes = (Type**)alloca(sizeof(Type*) * argCount);
 	for(U32 i=0; i<argCount; i++) {
 		argTypes[i] = getType(function.arguments[i]->type)->llType;
 	}
 
-	auto type = FunctionType::get(getType(function.type)->llType, ArrayRef<Type*>(argTypes, argCount), false);
+	return FunctionType::get(getType(function.type)->llType, ArrayRef<Type*>(argTypes, argCount), false);
+}
+
+Function* Generator::genFunctionDecl(resolve::FunctionDecl& function) {
+	auto type = genFunctionType(function);
 	if(function.isForeign) {
 		auto &ff = (resolve::ForeignFunction&)function;
-		auto func = Function::Create(type, Function::ExternalLinkage, toRef(ccontext.find(ff.importName).name), &module);
+		auto func = Function::Create(type, Function::ExternalLinkage, toRef(ccontext.find(ff.importName).name), module);
 		func->setCallingConv(getCconv(ff.cconv));
 		function.codegen = func;
 		return func;
 	} else {
-		auto func = Function::Create(type, Function::ExternalLinkage, toRef(ccontext.find(function.name).name), &module);
+		auto func = Function::Create(type, Function::ExternalLinkage, toRef(ccontext.find(function.name).name), module);
 		func->setCallingConv(CallingConv::Fast);
 		function.codegen = func;
 		if(function.hasImpl) {
@@ -48,6 +71,20 @@ Function* Generator::genFunctionDecl(resolve::FunctionDecl& function) {
 }
 
 void Generator::genFunction(Function* func, resolve::Function& function) {
+	// Constant functions are generated as a global containing their value.
+	// Any calls within the program were replaced by the value already, so the function only loads the global.
+	if(function.constant) {
+		auto type = getType(function.type)->llType;
+		auto value = (Constant*)genLiteral(function.constant->literal, function.type);
+		auto name = ccontext.find(function.name).name + ".value";
+		auto global = new GlobalVariable(*module, type, true, GlobalValue::PrivateLinkage, value, toRef(name));
+
+		SaveInsert save{builder};
+		builder.SetInsertPoint(BasicBlock::Create(context, "scope", func));
+		builder.CreateRet(builder.CreateLoad(global));
+		return;
+	}
+
 	// Generate the function arguments.
 	U32 i=0;
 	for(auto it=func->arg_begin(); i<function.arguments.size(); i++, it++) {
@@ -56,14 +93,57 @@ void Generator::genFunction(Function* func, resolve::Function& function) {
 		a->codegen = &*it;
 	}
 
+	// Find the mutable variables that can be kept in registers.
+	// Generating a call may generate the called function first, so the state of this function is restored afterwards.
+	SsaState state;
+	auto previousSsa = ssa;
+	ssa = &state;
+	if(function.expression) findEscapingVariables(*function.expression, false);
+
 	// Generate the function body.
 	auto scope = genScope(function.scope);
 	scope->insertInto(func);
+	sealBlock(scope);
 	if(function.expression) {
 		SaveInsert save{builder};
 		builder.SetInsertPoint(scope);
+
+		// Instrumented functions count each call and each loop iteration.
+		auto previousCounter = counter;
+		counter = functionTable ? functionTable->getCounter(function) : nullptr;
+		if(counter) genCounter(*counter);
+
 		genExpr(*function.expression);
+		counter = previousCounter;
 	}
+
+	finishSsa(func);
+	ssa = previousSsa;
+}
+
+void Generator::genCounter(FunctionCounter& counter) {
+	// The counter never moves, so it is referred to by its address directly.
+	auto countType = builder.getInt32Ty();
+	auto address = ConstantExpr::getIntToPtr(builder.getInt64((U64)&counter.count), countType->getPointerTo());
+	auto count = builder.CreateAdd(builder.CreateLoad(address), builder.getInt32(1));
+	builder.CreateStore(count, address);
+
+	// The callback is only made when the threshold is reached, rather than each time after that.
+	auto function = getFunction();
+	auto hotBlock = BasicBlock::Create(context, "hot", function);
+	auto contBlock = BasicBlock::Create(context, "cont", function);
+	builder.CreateCondBr(builder.CreateICmpEQ(count, builder.getInt32(counter.threshold)), hotBlock, contBlock);
+
+	sealBlock(hotBlock);
+	builder.SetInsertPoint(hotBlock);
+	auto bytePtr = builder.getInt8PtrTy();
+	auto hotType = FunctionType::get(builder.getVoidTy(), {bytePtr}, false);
+	auto hotFun = ConstantExpr::getIntToPtr(builder.getInt64((U64)counter.onHot), hotType->getPointerTo());
+	builder.CreateCall(hotType, hotFun, {ConstantExpr::getIntToPtr(builder.getInt64((U64)counter.data), bytePtr)});
+	builder.CreateBr(contBlock);
+
+	sealBlock(contBlock);
+	builder.SetInsertPoint(contBlock);
 }
 
 BasicBlock* Generator::genScope(resolve::Scope& scope) {
@@ -79,6 +159,13 @@ BasicBlock* Generator::genScope(resolve::Scope& scope) {
 
 void Generator::genVarDecl(resolve::Variable& v) {
 	auto type = getType(v.type);
+
+	// Primitive variables that are only read and assigned directly are kept in registers.
+	if(ssa && v.isVar() && v.type->isPtrOrPrim() && !type->onStack && !ssa->escaping.get(&v)) {
+		ssa->registers.add(&v, true);
+		return;
+	}
+
 	if(v.isVar() && !v.funParam) {
 		auto var = builder.CreateAlloca(type->llType, nullptr, toRef(ccontext.find(v.name).name));
 		v.codegen = var;
@@ -173,6 +260,15 @@ Value* Generator::genLoad(resolve::Expr& target) {
 
 Value* Generator::genStore(resolve::StoreExpr& expr) {
 	assert(expr.target.type->isLvalue());
+
+	// Variables in registers get a new definition instead.
+	// These are never stored to in places where the result of the store is used.
+	if(expr.target.isVar() && isRegister(*((resolve::VarExpr&)expr.target).var)) {
+		auto value = genExpr(expr.value);
+		writeVariable(*((resolve::VarExpr&)expr.target).var, builder.GetInsertBlock(), value);
+		return nullptr;
+	}
+
 	auto target = genExpr(expr.target);
 	builder.CreateStore(genExpr(expr.value), target);
 	return target;
@@ -197,8 +293,16 @@ Value* Generator::genRet(resolve::RetExpr& expr) {
 }
 
 Value* Generator::genCall(resolve::FunctionDecl& function, resolve::ExprList* argList) {
-	// Make sure this function has been generated.
-	if(!function.codegen) {
+	// Functions that are compiled separately are called through their code pointer.
+	// Modules that use a function table may be discarded after generation,
+	// so foreign functions are declared in each module that calls them instead of being shared.
+	// Otherwise, make sure this function has been generated.
+	bool indirect = functionTable && !function.isForeign;
+	Function* f = nullptr;
+	if(functionTable && function.isForeign) {
+		f = module->getFunction(toRef(ccontext.find(((resolve::ForeignFunction&)function).importName).name));
+		if(!f) f = genFunctionDecl(function);
+	} else if(!indirect && !function.codegen) {
 		genFunctionDecl(function);
 	}
 
@@ -213,7 +317,28 @@ Value* Generator::genCall(resolve::FunctionDecl& function, resolve::ExprList* ar
 		argList = argList->next;
 	}
 
-	auto f = (Function*)function.codegen;
+	if(indirect) {
+		// The code pointer is patched when the function is compiled, so it has to be loaded for each call.
+		auto type = genFunctionType(function);
+		auto slot = functionTable->getSlot(function);
+		auto slotType = type->getPointerTo()->getPointerTo();
+		auto code = builder.CreateLoad(ConstantExpr::getIntToPtr(builder.getInt64((U64)slot), slotType));
+		auto call = builder.CreateCall(type, code, ArrayRef<Value*>{args, argCount});
+		call->setCallingConv(CallingConv::Fast);
+		return call;
+	}
+
+	if(!f) f = (Function*)function.codegen;
+	if(f->getParent() != module) {
+		// Functions in a different module are called through a declaration in this one.
+		auto decl = module->getFunction(f->getName());
+		if(!decl) {
+			decl = Function::Create(f->getFunctionType(), Function::ExternalLinkage, f->getName(), module);
+			decl->setCallingConv(f->getCallingConv());
+		}
+		f = decl;
+	}
+
 	auto call = builder.CreateCall(f, ArrayRef<Value*>{args, argCount});
 	call->setCallingConv(f->getCallingConv());
 	return call;
@@ -431,10 +556,15 @@ Value* Generator::genIf(resolve::IfExpr& ife) {
 			} else {
 				builder.CreateCondBr(gen, nextCond, elseBlock ? elseBlock : contBlock);
 			}
+			sealBlock(nextCond);
 			builder.SetInsertPoint(nextCond);
 		}
 	}
 
+	// All branches into the then- and else-blocks exist now.
+	sealBlock(thenBlock);
+	if(elseBlock) sealBlock(elseBlock);
+
 	// Create "then" branch.
 	// The code generated by the block may create blocks of its own,
 	// which is why we retrieve the current block afterwards.
@@ -456,6 +586,7 @@ Value* Generator::genIf(resolve::IfExpr& ife) {
 	// If the expression returned a result, create a Phi node to capture it.
 	// Otherwise, return a void value.
 	// TODO: Should we explicitly use the stack for some types?
+	sealBlock(contBlock);
 	builder.SetInsertPoint(contBlock);
 	if(ife.returnResult && !ife.then.type->isUnit()) {
         assert(ife.otherwise && ife.then.type == ife.otherwise->type);
@@ -548,7 +679,16 @@ Value* Generator::genCoerceLV(resolve::Expr& src, resolve::Type* dst) {
     assert(src.type->isLvalue());
     assert(src.type->canonical == dst);
 
-	// LValues are always implicitly pointers in the code generator.
+	// Variables in registers are read from their current definition.
+	// The result of assigning to one is the definition that was just created.
+	auto target = &src;
+	if(src.kind == resolve::Expr::Store) target = &((resolve::StoreExpr&)src).target;
+	if(target->isVar() && isRegister(*((resolve::VarExpr*)target)->var)) {
+		if(target != &src) genStore((resolve::StoreExpr&)src);
+		return readVariable(*((resolve::VarExpr*)target)->var, builder.GetInsertBlock());
+	}
+
+	// Other LValues are always implicitly pointers in the code generator.
 	return builder.CreateLoad(genExpr(src));
 }
 
@@ -570,12 +710,18 @@ Value* Generator::genWhile(resolve::WhileExpr& expr) {
 	auto loopBlock = BasicBlock::Create(context, "loop", function);
 	auto contBlock = BasicBlock::Create(context, "cont", function);
 	builder.CreateCondBr(cond, loopBlock, contBlock);
+	sealBlock(loopBlock);
+	sealBlock(contBlock);
 
 	// Create loop branch.
 	builder.SetInsertPoint(loopBlock);
 	genExpr(expr.loop);
+	if(counter) genCounter(*counter);
 	builder.CreateBr(testBlock);
 
+	// The back edge is the last predecessor of the condition.
+	sealBlock(testBlock);
+
 	// Continue in this block.
 	builder.SetInsertPoint(contBlock);
 	return nullptr;
@@ -685,6 +831,7 @@ Value* Generator::genScoped(resolve::ScopedExpr& expr) {
 	if(!scope->empty()) {
 		scope->insertInto(getFunction());
 		builder.CreateBr(scope);
+		sealBlock(scope);
 		builder.SetInsertPoint(scope);
 	}
 
@@ -715,12 +862,14 @@ Value* Generator::genLazyCond(resolve::PrimitiveOp op, resolve::ExprRef lhs, res
 	}
 
 	// Create the rhs condition.
+	sealBlock(rhsBlock);
 	builder.SetInsertPoint(rhsBlock);
 	auto right = genExpr(rhs);
 	rhsBlock = builder.GetInsertBlock();
 	builder.CreateBr(contBlock);
 
 	// Create the expression result.
+	sealBlock(contBlock);
 	builder.SetInsertPoint(contBlock);
 	auto result = builder.CreatePHI(left->getType(), 2);
 	result->addIncoming(builder.getInt1(op == resolve::PrimitiveOp::Or), lhsBlock);
@@ -788,7 +937,7 @@ TypeData* Generator::genLlvmType(resolve::Type* type) {
 				auto fCount = con->contents.size();
 				if(fCount) {
 					auto s = getType(con->dataType);
-					auto& dl = module.getDataLayout();
+					auto& dl = module->getDataLayout();
 					auto align = dl.getPrefTypeAlignment(s->llType);
 					auto size = dl.getTypeAllocSize(s->llType);
 					if(align > totalAlignment || (align == totalAlignment && size > totalSize)) {
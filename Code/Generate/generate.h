@@ -20,7 +20,9 @@ struct SaveInsert {
 	}
 
 	~SaveInsert() {
-		builder.SetInsertPoint(block, insert);
+		// The builder may not have had an insert point, such as when generating the first function.
+		if(block) builder.SetInsertPoint(block, insert);
+		else builder.ClearInsertionPoint();
 	}
 
 	llvm::IRBuilder<>& builder;
@@ -38,12 +40,67 @@ struct TypeData {
 	bool onStack = false;
 };
 
+/// Counts how often a function is used by generated code.
+struct FunctionCounter {
+	U32 count;     // Incremented on each call to the function and on each iteration of a loop in it.
+	U32 threshold; // When the count reaches this value, onHot is called with the provided data.
+	void (*onHot)(void* data);
+	void* data;
+};
+
+/// Identifies the definition of a variable at the end of a basic block.
+struct SsaKey {
+	llvm::BasicBlock* block;
+	resolve::Variable* var;
+
+	bool operator == (const SsaKey& k) const {return block == k.block && var == k.var;}
+	bool operator < (const SsaKey& k) const {return block < k.block || (block == k.block && var < k.var);}
+};
+
+/**
+ * The state used to build SSA form directly for the mutable variables of a function.
+ * Variables whose address is never needed are kept in registers instead of stack memory,
+ * which keeps the generated code small even when it is not optimized.
+ * This uses the algorithm from "Simple and Efficient Construction of Static Single Assignment Form" by Braun et al.
+ */
+struct SsaState {
+	struct IncompletePhi {
+		llvm::BasicBlock* block;
+		resolve::Variable* var;
+		llvm::PHINode* phi;
+	};
+
+	Tritium::Map<resolve::Variable*, bool> escaping;  // Mutable variables that are used as lvalues.
+	Tritium::Map<resolve::Variable*, bool> registers; // Mutable variables that are kept in registers.
+	Tritium::Map<SsaKey, llvm::Value*> definitions;   // The current value of each variable at the end of each block.
+	Tritium::Map<llvm::Value*, llvm::Value*> replaced; // Trivial phis and the value they were replaced by.
+	Tritium::Map<llvm::BasicBlock*, bool> sealed;      // Blocks whose predecessors are all known.
+	Array<IncompletePhi> incompletePhis; // Phis in blocks that are not sealed yet, which are missing their operands.
+	Array<llvm::PHINode*> removedPhis;   // Trivial phis that no longer have any uses.
+};
+
+/// Provides the code pointer of each function when functions are compiled separately, such as in the lazy JIT.
+struct FunctionTable {
+	/// Returns the address of the code pointer that is used to call the provided function.
+	/// The pointer must stay valid and callable for as long as generated code uses it.
+	virtual void** getSlot(resolve::FunctionDecl& function) = 0;
+
+	/// Returns the counter to instrument the provided function with, or null if it should not be instrumented.
+	/// The counter must stay valid for as long as generated code uses it.
+	virtual FunctionCounter* getCounter(resolve::FunctionDecl& function) {return nullptr;}
+};
+
 struct Generator {
 	Generator(ast::CompileContext& ccontext, llvm::LLVMContext& context, llvm::Module& target);
 
+	/// Changes the module that new functions are generated into.
+	/// Functions that were generated into a different module are called through declarations.
+	void setTarget(llvm::Module& target) {module = &target;}
+
 	llvm::Module* generate(resolve::Module& module);
 	void genFunction(llvm::Function* function, resolve::Function& decl);
 	llvm::Function* genFunctionDecl(resolve::FunctionDecl& function);
+	llvm::FunctionType* genFunctionType(resolve::FunctionDecl& function);
 	llvm::BasicBlock* genScope(resolve::Scope& scope);
 	llvm::Value* genExpr(resolve::ExprRef expr);
 	llvm::Value* genLiteral(resolve::Literal& literal, resolve::Type* type);
@@ -70,12 +127,27 @@ struct Generator {
 	llvm::Value* genScoped(resolve::ScopedExpr& expr);
 	llvm::Value* genLazyCond(resolve::PrimitiveOp op, resolve::ExprRef lhs, resolve::ExprRef rhs);
 	void genVarDecl(resolve::Variable& var);
+	void genCounter(FunctionCounter& counter);
+
+	// Direct SSA construction for mutable variables, which is implemented in generate_ssa.cpp.
+	void findEscapingVariables(resolve::ExprRef expr, bool used);
+	bool isRegister(resolve::Variable& var);
+	void writeVariable(resolve::Variable& var, llvm::BasicBlock* block, llvm::Value* value);
+	llvm::Value* readVariable(resolve::Variable& var, llvm::BasicBlock* block);
+	llvm::Value* readVariableRecursive(resolve::Variable& var, llvm::BasicBlock* block);
+	llvm::Value* addPhiOperands(resolve::Variable& var, llvm::PHINode* phi);
+	llvm::Value* tryRemoveTrivialPhi(llvm::PHINode* phi);
+	void sealBlock(llvm::BasicBlock* block);
+	void finishSsa(llvm::Function* function);
 
 	llvm::Function* getFunction() {
 		return builder.GetInsertBlock()->getParent();
 	}
 
 	TypeData* getType(resolve::Type* type) {
+		// Generic types that were solved by type inference are equivalent to their solution.
+		if(type->isGeneric()) type = resolve::solvedType(type);
+
 		if(!type->codegen) {
 			type->codegen = genLlvmType(type);
 		}
@@ -100,11 +172,16 @@ struct Generator {
 		return llvm::CallingConv::C;
 	}
 
+	// If set, calls to functions that are not foreign go through the code pointers in this table.
+	FunctionTable* functionTable = nullptr;
+
 private:
 	TypeData* genLlvmType(resolve::Type* type);
 
 	llvm::LLVMContext& context;
-	llvm::Module& module;
+	llvm::Module* module;
+	FunctionCounter* counter = nullptr; // The counter of the function that is being generated, if it is instrumented.
+	SsaState* ssa = nullptr; // The SSA state of the function that is being generated.
 	llvm::IRBuilder<> builder;
 	ast::CompileContext& ccontext;
 };
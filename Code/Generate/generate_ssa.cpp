@@ -0,0 +1,238 @@
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#define __STDC_LIMIT_MACROS
+
+#include <llvm/IR/CFG.h>
+#include <llvm/IR/Module.h>
+#include "generate.h"
+
+using namespace llvm;
+
+namespace athena {
+namespace gen {
+
+/*
+ * Mutable variables are lvalues, which the generator normally represents as a stack allocation.
+ * Most variables are only ever read and assigned though, in which case they can be kept in registers instead.
+ * For these variables, each basic block tracks the current definition of the variable,
+ * and reading it in a block that has multiple predecessors creates a phi node that merges their definitions.
+ * Blocks are sealed once all their predecessors are known. Until then, reads create phi nodes without operands,
+ * which are completed when the block is sealed. Phi nodes that turn out to merge a single value are removed again.
+ */
+
+void Generator::findEscapingVariables(resolve::ExprRef expr, bool used) {
+	auto exprs = [&](resolve::ExprList* list) {
+		ast::walk(list, [&](resolve::Expr* e) {this->findEscapingVariables(*e, true);});
+	};
+
+	switch(expr.kind) {
+		case resolve::Expr::Multi: {
+			// Only the last expression in a sequence produces its value.
+			auto& es = ((resolve::MultiExpr&)expr).es;
+			for(U32 i = 0; i < es.size(); i++) {
+				findEscapingVariables(*es[i], used && i == es.size() - 1);
+			}
+			break;
+		}
+		case resolve::Expr::Var:
+			// Any variable that is used as an lvalue, other than being read or assigned directly, needs an address.
+			ssa->escaping.add(((resolve::VarExpr&)expr).var, true);
+			break;
+		case resolve::Expr::Load:
+			findEscapingVariables(((resolve::LoadExpr&)expr).target, true);
+			break;
+		case resolve::Expr::Store: {
+			// Declarations are lvalues themselves, so a store whose result is used needs the address of its target.
+			auto& store = (resolve::StoreExpr&)expr;
+			if(used || !store.target.isVar()) findEscapingVariables(store.target, true);
+			findEscapingVariables(store.value, true);
+			break;
+		}
+		case resolve::Expr::App:
+			exprs(((resolve::AppExpr&)expr).args);
+			break;
+		case resolve::Expr::AppI:
+			exprs(((resolve::AppIExpr&)expr).args);
+			break;
+		case resolve::Expr::AppP:
+			exprs(((resolve::AppPExpr&)expr).args);
+			break;
+		case resolve::Expr::Case: {
+			auto& casee = (resolve::CaseExpr&)expr;
+			ast::walk(casee.alts, [&](resolve::Alt* alt) {
+				if(alt->cond) this->findEscapingVariables(*alt->cond, true);
+				if(alt->result) this->findEscapingVariables(*alt->result, true);
+			});
+			if(casee.otherwise) findEscapingVariables(*casee.otherwise, true);
+			break;
+		}
+		case resolve::Expr::If: {
+			auto& ife = (resolve::IfExpr&)expr;
+			for(auto& c : ife.conds) {
+				if(c.scope) findEscapingVariables(*c.scope, false);
+				if(c.cond) findEscapingVariables(*c.cond, true);
+			}
+			findEscapingVariables(ife.then, ife.returnResult);
+			if(ife.otherwise) findEscapingVariables(*ife.otherwise, ife.returnResult);
+			break;
+		}
+		case resolve::Expr::While:
+			findEscapingVariables(((resolve::WhileExpr&)expr).cond, true);
+			findEscapingVariables(((resolve::WhileExpr&)expr).loop, false);
+			break;
+		case resolve::Expr::Assign:
+			findEscapingVariables(((resolve::AssignExpr&)expr).value, true);
+			break;
+		case resolve::Expr::Coerce:
+			findEscapingVariables(((resolve::CoerceExpr&)expr).src, true);
+			break;
+		case resolve::Expr::CoerceLV: {
+			// Reading a variable directly, or the result of assigning to it, only needs its current value.
+			auto& src = ((resolve::CoerceLVExpr&)expr).src;
+			if(src.kind == resolve::Expr::Store && ((resolve::StoreExpr&)src).target.isVar()) {
+				findEscapingVariables(((resolve::StoreExpr&)src).value, true);
+			} else if(!src.isVar()) {
+				findEscapingVariables(src, true);
+			}
+			break;
+		}
+		case resolve::Expr::Field:
+			findEscapingVariables(((resolve::FieldExpr&)expr).container, true);
+			break;
+		case resolve::Expr::Ret:
+			findEscapingVariables(((resolve::RetExpr&)expr).expr, true);
+			break;
+		case resolve::Expr::Construct:
+			for(auto& a : ((resolve::ConstructExpr&)expr).args) findEscapingVariables(a.expr, true);
+			break;
+		case resolve::Expr::Scoped: {
+			auto& scoped = (resolve::ScopedExpr&)expr;
+			if(scoped.contents) findEscapingVariables(*scoped.contents, used);
+			break;
+		}
+		default:
+			// Literals don't use any variables.
+			break;
+	}
+}
+
+bool Generator::isRegister(resolve::Variable& var) {
+	return ssa && ssa->registers.get(&var);
+}
+
+void Generator::writeVariable(resolve::Variable& var, BasicBlock* block, Value* value) {
+	ssa->definitions.add(SsaKey{block, &var}, value);
+}
+
+Value* Generator::readVariable(resolve::Variable& var, BasicBlock* block) {
+	if(auto d = ssa->definitions.get(SsaKey{block, &var})) {
+		// The definition may be a phi that was removed after it was recorded.
+		auto value = *d.force();
+		while(auto r = ssa->replaced.get(value)) value = *r.force();
+		return value;
+	}
+
+	return readVariableRecursive(var, block);
+}
+
+Value* Generator::readVariableRecursive(resolve::Variable& var, BasicBlock* block) {
+	auto type = getType(var.type)->llType;
+	auto createPhi = [&]() -> PHINode* {
+		// Phi nodes have to be at the start of their block, even if code was generated into it already.
+		auto first = block->getFirstNonPHI();
+		return first ? PHINode::Create(type, 0, "", first) : PHINode::Create(type, 0, "", block);
+	};
+
+	Value* value;
+	if(!ssa->sealed.get(block)) {
+		// Not all predecessors are known yet, so the operands are added when the block is sealed.
+		auto phi = createPhi();
+		ssa->incompletePhis << SsaState::IncompletePhi{block, &var, phi};
+		value = phi;
+	} else if(auto pred = block->getSinglePredecessor()) {
+		value = readVariable(var, pred);
+	} else if(pred_begin(block) == pred_end(block)) {
+		// The variable is read before it is assigned.
+		value = UndefValue::get(type);
+	} else {
+		// The phi is defined before reading the predecessors, which breaks cycles through loops.
+		auto phi = createPhi();
+		writeVariable(var, block, phi);
+		value = addPhiOperands(var, phi);
+	}
+
+	writeVariable(var, block, value);
+	return value;
+}
+
+Value* Generator::addPhiOperands(resolve::Variable& var, PHINode* phi) {
+	auto block = phi->getParent();
+	for(auto it = pred_begin(block), end = pred_end(block); it != end; ++it) {
+		phi->addIncoming(readVariable(var, *it), *it);
+	}
+	return tryRemoveTrivialPhi(phi);
+}
+
+Value* Generator::tryRemoveTrivialPhi(PHINode* phi) {
+	// A phi is trivial if it merges a single value, apart from references to itself.
+	Value* same = nullptr;
+	for(auto& op : phi->incoming_values()) {
+		if(op == same || op == phi) continue;
+		if(same) return phi;
+		same = op;
+	}
+
+	if(!same) same = UndefValue::get(phi->getType());
+
+	// Replacing the phi may make the phis that use it trivial as well.
+	Array<PHINode*> users;
+	for(auto user : phi->users()) {
+		if(user != phi && isa<PHINode>(user)) users << cast<PHINode>(user);
+	}
+
+	// The phi is only removed from its block when the function is finished,
+	// since it can still be referenced by the definitions and the phis that are being completed.
+	phi->replaceAllUsesWith(same);
+	ssa->replaced.add(phi, same);
+	ssa->removedPhis << phi;
+
+	for(auto user : users) {
+		if(!ssa->replaced.get(user)) tryRemoveTrivialPhi(user);
+	}
+
+	while(auto r = ssa->replaced.get(same)) same = *r.force();
+	return same;
+}
+
+void Generator::sealBlock(BasicBlock* block) {
+	if(!ssa || ssa->sealed.get(block)) return;
+
+	ssa->sealed.add(block, true);
+
+	// Completing a phi can read variables in other blocks, which may add new incomplete phis.
+	for(U32 i = 0; i < ssa->incompletePhis.size();) {
+		auto p = ssa->incompletePhis[i];
+		if(p.block == block) {
+			ssa->incompletePhis.remove(i);
+			addPhiOperands(*p.var, p.phi);
+		} else {
+			i++;
+		}
+	}
+}
+
+void Generator::finishSsa(Function* function) {
+	// All predecessors are known once the whole function is generated.
+	for(auto& block : *function) sealBlock(&block);
+
+	for(auto phi : ssa->removedPhis) {
+		phi->dropAllReferences();
+	}
+
+	for(auto phi : ssa->removedPhis) {
+		phi->eraseFromParent();
+	}
+}
+
+}} // namespace athena::gen
@@ -0,0 +1,188 @@
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#define __STDC_LIMIT_MACROS
+
+#include <vector>
+#include <llvm/ADT/Triple.h>
+#include <llvm/Config/llvm-config.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/Object/ArchiveWriter.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MD5.h>
+#include <llvm/Support/raw_ostream.h>
+#include <llvm/Transforms/Utils/Cloning.h>
+#include <llvm/Transforms/Utils/ValueMapper.h>
+#include "incremental.h"
+#include "emit.h"
+#include "cache.h"
+
+using namespace llvm;
+
+namespace athena {
+namespace gen {
+
+// This has to be changed whenever the generated objects change for the same IR.
+static const char* objectFormat = "athena-objects-1";
+
+static GlobalValue* copyGlobal(llvm::Module& module, GlobalValue& global, ValueToValueMapTy& map);
+
+/// Makes sure that each global referenced by the value exists in the module.
+static void copyReferences(llvm::Module& module, Value* value, ValueToValueMapTy& map) {
+	if(auto global = dyn_cast<GlobalValue>(value)) {
+		copyGlobal(module, *global, map);
+	} else if(auto constant = dyn_cast<Constant>(value)) {
+		for(auto& op : constant->operands()) copyReferences(module, op, map);
+	}
+}
+
+static void copyBody(llvm::Module& module, llvm::Function& from, llvm::Function& to, ValueToValueMapTy& map) {
+	for(auto& block : from) {
+		for(auto& inst : block) {
+			for(auto& op : inst.operands()) copyReferences(module, op, map);
+		}
+	}
+
+	auto arg = to.arg_begin();
+	for(auto& a : from.args()) {
+		arg->setName(a.getName());
+		map[&a] = &*arg++;
+	}
+
+	SmallVector<ReturnInst*, 8> returns;
+	CloneFunctionInto(&to, &from, map, true, returns);
+}
+
+static GlobalValue* copyGlobal(llvm::Module& module, GlobalValue& global, ValueToValueMapTy& map) {
+	auto existing = map.find(&global);
+	if(existing != map.end()) return cast<GlobalValue>(existing->second);
+
+	// Globals that are local to the module cannot be referred to from another object, so they are copied.
+	// Each function then has its own copy, which is fine since these are only constants and helpers.
+	bool copy = global.hasLocalLinkage();
+	auto linkage = copy ? global.getLinkage() : GlobalValue::ExternalLinkage;
+
+	if(auto function = dyn_cast<Function>(&global)) {
+		auto f = Function::Create(function->getFunctionType(), linkage, function->getName(), &module);
+		f->copyAttributesFrom(function);
+		f->setLinkage(linkage);
+		map[function] = f;
+
+		if(copy && !function->isDeclaration()) copyBody(module, *function, *f, map);
+		return f;
+	}
+
+	auto& var = cast<GlobalVariable>(global);
+	auto v = new GlobalVariable(module, var.getValueType(), var.isConstant(), linkage, nullptr, var.getName());
+	v->copyAttributesFrom(&var);
+	v->setLinkage(linkage);
+	map[&var] = v;
+
+	if(copy && var.hasInitializer()) {
+		copyReferences(module, var.getInitializer(), map);
+		v->setInitializer(MapValue(var.getInitializer(), map));
+	}
+	return v;
+}
+
+std::unique_ptr<llvm::Module> extractFunction(llvm::Function& function) {
+	auto& source = *function.getParent();
+	std::unique_ptr<llvm::Module> module{new llvm::Module(function.getName(), source.getContext())};
+	module->setSourceFileName(function.getName());
+	module->setTargetTriple(source.getTargetTriple());
+	module->setDataLayout(source.getDataLayout());
+
+	ValueToValueMapTy map;
+	auto f = cast<Function>(copyGlobal(*module, function, map));
+	if(!function.hasLocalLinkage()) copyBody(*module, function, *f, map);
+	return module;
+}
+
+/// Returns the fingerprint of a module that contains a single function.
+static std::string getFingerprint(llvm::Module& module, TargetMachine& target) {
+	std::string text;
+	{
+		raw_string_ostream stream{text};
+		module.print(stream, nullptr);
+	}
+
+	MD5 hash;
+	hash.update(objectFormat);
+	hash.update(LLVM_VERSION_STRING);
+	hash.update(target.getTargetCPU());
+	hash.update(target.getTargetFeatureString());
+	hash.update(std::to_string((int)target.getOptLevel()));
+	hash.update(text);
+
+	MD5::MD5Result result;
+	hash.final(result);
+
+	SmallString<32> string;
+	MD5::stringifyResult(result, string);
+	return string.str().str();
+}
+
+bool emitIncremental(llvm::Module& module, llvm::TargetMachine& target, const std::string& cacheDirectory,
+					 const std::string& file, IncrementalStats& stats, std::string& error) {
+	if(auto code = sys::fs::create_directories(cacheDirectory)) {
+		error = "cannot create the cache directory '" + cacheDirectory + "': " + code.message();
+		return false;
+	}
+
+	// Functions that are local to the module are copied into each function that uses them instead.
+	std::vector<std::string> objects;
+	for(auto& function : module) {
+		if(function.isDeclaration() || function.hasLocalLinkage()) continue;
+
+		auto part = extractFunction(function);
+		auto path = cacheDirectory + "/" + getFingerprint(*part, target) + ".o";
+		objects.push_back(path);
+
+		if(sys::fs::exists(path)) {
+			markUsed(path);
+			stats.reused++;
+			continue;
+		}
+
+		// The object is written to a temporary file first,
+		// so that other compilations never see a partially written object.
+		SmallString<128> tempPath;
+		if(auto code = sys::fs::createUniqueFile(cacheDirectory + "/%%%%%%%%.tmp", tempPath)) {
+			error = "cannot create a cache entry: " + code.message();
+			return false;
+		}
+
+		if(!emitFile(*part, target, tempPath.str().str(), OutputKind::Object, error)) {
+			sys::fs::remove(tempPath);
+			return false;
+		}
+
+		if(auto code = sys::fs::rename(tempPath, path)) {
+			sys::fs::remove(tempPath);
+			error = "cannot create a cache entry: " + code.message();
+			return false;
+		}
+
+		stats.compiled++;
+	}
+
+	std::vector<NewArchiveMember> members;
+	for(auto& object : objects) {
+		auto member = NewArchiveMember::getFile(object, true);
+		if(!member) {
+			error = "cannot read '" + object + "': " + toString(member.takeError());
+			return false;
+		}
+		members.push_back(std::move(*member));
+	}
+
+	auto kind = Triple{module.getTargetTriple()}.isOSDarwin() ? object::Archive::K_BSD : object::Archive::K_GNU;
+	if(auto e = writeArchive(file, members, true, kind, true, false)) {
+		error = "cannot write '" + file + "': " + toString(std::move(e));
+		return false;
+	}
+
+	return true;
+}
+
+}} // namespace athena::gen
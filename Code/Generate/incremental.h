@@ -0,0 +1,34 @@
+#ifndef Athena_Generate_incremental_h
+#define Athena_Generate_incremental_h
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include "../General/compiler.h"
+
+namespace athena {
+namespace gen {
+
+/// The number of functions that had to be compiled by an incremental build, and the number that were reused.
+struct IncrementalStats {
+	U32 compiled = 0;
+	U32 reused = 0;
+};
+
+/// Copies a single function into a new module, together with the private globals and functions it uses.
+/// Anything else the function refers to is declared in the new module.
+std::unique_ptr<llvm::Module> extractFunction(llvm::Function& function);
+
+/**
+ * Compiles each function in the module into its own object file, which is kept in the cache directory.
+ * Each object is named by a fingerprint of its function in isolation: its optimized IR, which contains its body,
+ * the signatures of the functions it calls and the types it uses, together with the target and code generation level.
+ * Only functions whose fingerprint changed since an earlier build have to be compiled, while the others reuse their object.
+ * The objects are then combined into a static archive, which can be linked like a single object file.
+ * Returns false and sets the error message if any object or the archive could not be written.
+ */
+bool emitIncremental(llvm::Module& module, llvm::TargetMachine& target, const std::string& cacheDirectory,
+					 const std::string& file, IncrementalStats& stats, std::string& error);
+
+}} // namespace athena::gen
+
+#endif // Athena_Generate_incremental_h
@@ -0,0 +1,334 @@
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#define __STDC_LIMIT_MACROS
+
+#include <algorithm>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/Bitcode/BitcodeReader.h>
+#include <llvm/Bitcode/BitcodeWriter.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include <llvm/ExecutionEngine/MCJIT.h>
+#include <llvm/ExecutionEngine/SectionMemoryManager.h>
+#include <llvm/Support/DynamicLibrary.h>
+#include "jit.h"
+#include "emit.h"
+#include "optimize.h"
+
+using namespace llvm;
+
+namespace athena {
+namespace gen {
+
+Function* createEntryThunk(llvm::Module& module, Function* entry) {
+	auto& context = module.getContext();
+	IRBuilder<> builder{context};
+
+	auto type = FunctionType::get(builder.getInt32Ty(), false);
+	auto thunk = Function::Create(type, Function::ExternalLinkage, "athena.main", &module);
+	builder.SetInsertPoint(BasicBlock::Create(context, "", thunk));
+
+	auto call = builder.CreateCall(entry);
+	call->setCallingConv(entry->getCallingConv());
+
+	// Integer results are used as the exit code, while any other result means success.
+	auto result = entry->getReturnType();
+	if(result->isIntegerTy()) {
+		builder.CreateRet(builder.CreateSExtOrTrunc(call, builder.getInt32Ty()));
+	} else {
+		builder.CreateRet(builder.getInt32(0));
+	}
+
+	return thunk;
+}
+
+/// Creates a JIT engine for the module, which generates code for the CPU and features in the provided settings.
+static ExecutionEngine* createEngine(std::unique_ptr<llvm::Module> module, const CompileSettings& settings, CodeGenOpt::Level level, std::string& error) {
+	SmallVector<StringRef, 32> features;
+	auto featureString = getTargetFeatures(settings);
+	StringRef{featureString}.split(features, ',', -1, false);
+
+	return EngineBuilder{std::move(module)}
+		.setEngineKind(EngineKind::JIT)
+		.setErrorStr(&error)
+		.setOptLevel(level)
+		.setMCPU(getTargetCpu(settings))
+		.setMAttrs(std::vector<std::string>{features.begin(), features.end()})
+		.setMCJITMemoryManager(std::unique_ptr<RTDyldMemoryManager>{new SectionMemoryManager})
+		.create();
+}
+
+bool runModule(std::unique_ptr<llvm::Module> module, Function* thunk, const CompileSettings& settings, int& result, std::string& error) {
+	initTargets();
+
+	// Make the symbols of the host process available to foreign imports.
+	sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+	auto name = thunk->getName().str();
+	std::unique_ptr<ExecutionEngine> engine{createEngine(std::move(module), settings, getCodeGenLevel(settings), error)};
+
+	if(!engine) return false;
+
+	engine->finalizeObject();
+	auto address = engine->getFunctionAddress(name);
+	if(!address) {
+		error = "cannot find the entry function";
+		return false;
+	}
+
+	result = ((int(*)())address)();
+	return true;
+}
+
+// Called by the stub of each function that has not been compiled yet.
+static void* athena_jit_compile(JitSlot* slot) {
+	return slot->jit->compile(*slot);
+}
+
+// Called by instrumented functions when they become hot.
+static void athena_jit_promote(void* slot) {
+	((JitSlot*)slot)->jit->promote(*(JitSlot*)slot);
+}
+
+LazyJit::LazyJit(ast::CompileContext& context, llvm::LLVMContext& llcontext, const CompileSettings& settings) :
+	context(context), llcontext(llcontext), settings(settings),
+	initial(new llvm::Module("athena.jit", llcontext)), gen(context, llcontext, *initial) {
+	initial->setTargetTriple(getTargetTriple(settings));
+	gen.functionTable = this;
+}
+
+LazyJit::~LazyJit() {
+	if(optimizer.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock{queueLock};
+			stopping = true;
+		}
+		queueSignal.notify_one();
+		optimizer.join();
+	}
+
+	for(auto job : queue) jobs.destroy(job);
+}
+
+bool LazyJit::init(std::string& error) {
+	initTargets();
+
+	// Make the symbols of the host process available to foreign imports.
+	sys::DynamicLibrary::LoadLibraryPermanently(nullptr);
+
+	// In tiered mode, code is compiled as fast as possible until it turns out to be hot.
+	engine.reset(createEngine(std::move(initial), settings, settings.tieredJit ? CodeGenOpt::None : getCodeGenLevel(settings), error));
+
+	if(!engine) return false;
+
+	if(settings.tieredJit) {
+		optimizer = std::thread{[this] {runOptimizer();}};
+	}
+	return true;
+}
+
+bool LazyJit::run(resolve::FunctionDecl& entry, int& result, std::string& error) {
+	// The thunk calls the stub of the entry function, which compiles it.
+	getSlot(entry);
+
+	auto module = createModule("athena.main");
+	auto stub = Function::Create(gen.genFunctionType(entry), Function::ExternalLinkage, getStubName(entry), module.get());
+	stub->setCallingConv(CallingConv::Fast);
+	createEntryThunk(*module, stub);
+
+	auto thunk = addModule(std::move(module), "athena.main");
+	if(!thunk) {
+		error = "cannot compile the entry function";
+		return false;
+	}
+
+	result = ((int(*)())thunk)();
+	return true;
+}
+
+void** LazyJit::getSlot(resolve::FunctionDecl& function) {
+	JitSlot** s;
+	if(slots.addGet(&function, s)) return &(*s)->code;
+
+	auto slot = slotData.create();
+	*s = slot;
+	slot->function = &function;
+	slot->jit = this;
+	slot->stub = createStub(*slot);
+	slot->code = slot->stub;
+	slot->counter.count = 0;
+	slot->counter.threshold = settings.tierThreshold;
+	slot->counter.onHot = &athena_jit_promote;
+	slot->counter.data = slot;
+	slot->promoted = false;
+	return &slot->code;
+}
+
+FunctionCounter* LazyJit::getCounter(resolve::FunctionDecl& function) {
+	if(!settings.tieredJit || !instrument) return nullptr;
+
+	auto slot = slots.get(&function);
+	return slot ? &(*slot.force())->counter : nullptr;
+}
+
+void* LazyJit::compile(JitSlot& slot) {
+	// Functions that were called through an old code pointer may request compilation more than once.
+	if(slot.code != slot.stub) return slot.code;
+
+	auto& function = *slot.function;
+	auto module = createModule(context.find(function.name).name);
+
+	// Any functions called from this one get their own stub instead of being generated here.
+	gen.setTarget(*module);
+	auto f = gen.genFunctionDecl(function);
+	auto name = f->getName().str();
+
+	// In tiered mode, functions are only optimized once they are hot.
+	if(!settings.tieredJit) optimize(*module, *engine->getTargetMachine(), settings);
+	slot.code = addModule(std::move(module), name);
+	compiledCount++;
+	return slot.code;
+}
+
+void LazyJit::promote(JitSlot& slot) {
+	// The counter wraps around eventually, which would trigger another promotion.
+	if(slot.promoted) return;
+	slot.promoted = true;
+
+	// Generate the function again without counters.
+	// Calls from it go through code pointers, so the module doesn't refer to any other module and can be compiled anywhere.
+	auto& function = *slot.function;
+	auto module = createModule(context.find(function.name).name + ".opt");
+
+	instrument = false;
+	gen.setTarget(*module);
+	auto name = gen.genFunctionDecl(function)->getName().str();
+	instrument = true;
+
+	// LLVM contexts cannot be shared between threads, so the optimizer receives the module as bitcode.
+	auto job = jobs.create();
+	job->slot = &slot;
+	job->function = std::move(name);
+	{
+		raw_string_ostream stream{job->bitcode};
+		WriteBitcodeToFile(module.get(), stream);
+	}
+
+	{
+		std::lock_guard<std::mutex> lock{queueLock};
+		queue.push_back(job);
+	}
+	queueSignal.notify_one();
+}
+
+void LazyJit::runOptimizer() {
+	// Hot functions are optimized at least as much as a normal -O2 build.
+	auto optimized = settings;
+	optimized.optLevel = std::max(settings.optLevel, 2u);
+	optimized.timePasses = false;
+
+	// The engine doesn't exist until the first module is added, so the optimizer uses a target machine of its own.
+	// The targets were registered by init() before this thread was started.
+	std::string error;
+	std::unique_ptr<TargetMachine> target{createTargetMachine(optimized, error)};
+	if(!target) return;
+
+	LLVMContext llcontext;
+	std::unique_ptr<ExecutionEngine> engine;
+
+	// Returns false if no more jobs can be compiled.
+	auto compileJob = [&](TierJob& job) {
+		auto module = parseBitcodeFile(MemoryBufferRef{job.bitcode, job.function}, llcontext);
+		if(!module) {
+			// The unoptimized code keeps being used.
+			consumeError(module.takeError());
+			return true;
+		}
+
+		optimize(**module, *target, optimized);
+
+		// The engine is created with the first module, since it needs one.
+		if(engine) {
+			engine->addModule(std::move(*module));
+		} else {
+			engine.reset(createEngine(std::move(*module), optimized, getCodeGenLevel(optimized), error));
+			if(!engine) return false;
+		}
+
+		// The code pointer is read by the program while it runs, so it is replaced atomically.
+		if(auto address = engine->getFunctionAddress(job.function)) {
+			__atomic_store_n(&job.slot->code, (void*)address, __ATOMIC_RELEASE);
+			optimizedCount++;
+		}
+		return true;
+	};
+
+	while(true) {
+		TierJob* job;
+		{
+			std::unique_lock<std::mutex> lock{queueLock};
+			queueSignal.wait(lock, [this] {return stopping || !queue.empty();});
+			if(stopping) return;
+
+			job = queue.front();
+			queue.pop_front();
+		}
+
+		auto ok = compileJob(*job);
+		jobs.destroy(job);
+		if(!ok) return;
+	}
+}
+
+std::unique_ptr<llvm::Module> LazyJit::createModule(const std::string& name) {
+	std::unique_ptr<llvm::Module> module{new llvm::Module(name, llcontext)};
+	module->setDataLayout(engine->getDataLayout());
+	module->setTargetTriple(engine->getTargetMachine()->getTargetTriple().str());
+	return module;
+}
+
+void* LazyJit::addModule(std::unique_ptr<llvm::Module> module, const std::string& function) {
+	engine->addModule(std::move(module));
+	return (void*)engine->getFunctionAddress(function);
+}
+
+void* LazyJit::createStub(JitSlot& slot) {
+	auto& function = *slot.function;
+	auto type = gen.genFunctionType(function);
+	auto name = getStubName(function);
+	auto module = createModule(name);
+
+	auto stub = Function::Create(type, Function::ExternalLinkage, name, module.get());
+	stub->setCallingConv(CallingConv::Fast);
+
+	IRBuilder<> builder{llcontext};
+	builder.SetInsertPoint(BasicBlock::Create(llcontext, "", stub));
+
+	// Compile the function, then forward the arguments to it.
+	// The callback and slot never move, so they are referred to by their addresses directly.
+	auto bytePtr = builder.getInt8PtrTy();
+	auto compileType = FunctionType::get(bytePtr, {bytePtr}, false);
+	auto compileFun = ConstantExpr::getIntToPtr(builder.getInt64((U64)&athena_jit_compile), compileType->getPointerTo());
+	auto code = builder.CreateCall(compileType, compileFun, {ConstantExpr::getIntToPtr(builder.getInt64((U64)&slot), bytePtr)});
+
+	auto argCount = type->getNumParams();
+	auto args = (Value**)alloca(sizeof(Value*) * argCount);
+	U32 i = 0;
+	for(auto it = stub->arg_begin(); i < argCount; i++, it++) {
+		args[i] = &*it;
+	}
+
+	auto call = builder.CreateCall(type, builder.CreatePointerCast(code, type->getPointerTo()), ArrayRef<Value*>{args, argCount});
+	call->setCallingConv(CallingConv::Fast);
+	call->setTailCall();
+
+	if(type->getReturnType()->isVoidTy()) {
+		builder.CreateRetVoid();
+	} else {
+		builder.CreateRet(call);
+	}
+
+	return addModule(std::move(module), name);
+}
+
+}} // namespace athena::gen
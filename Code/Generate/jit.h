@@ -0,0 +1,128 @@
+#ifndef Athena_Generate_jit_h
+#define Athena_Generate_jit_h
+
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <llvm/IR/Module.h>
+#include <llvm/ExecutionEngine/ExecutionEngine.h>
+#include "../General/compiler.h"
+#include "../General/map.h"
+#include "../General/pool.h"
+#include "generate.h"
+
+namespace athena {
+namespace gen {
+
+/// Creates a function with the C calling convention that calls the provided entry function and returns its result as an exit code.
+/// Generated functions use the fast calling convention, so they cannot be called from the host directly.
+llvm::Function* createEntryThunk(llvm::Module& module, llvm::Function* entry);
+
+/// Compiles the module in memory and runs the provided entry thunk.
+/// Foreign functions are resolved against the symbols that are loaded in the host process.
+/// Returns false and sets the error message if the module could not be compiled.
+bool runModule(std::unique_ptr<llvm::Module> module, llvm::Function* thunk, const CompileSettings& settings, int& result, std::string& error);
+
+struct LazyJit;
+
+/// The code pointer of a function that is compiled by the lazy JIT.
+struct JitSlot {
+	void* code;   // The address that calls to the function jump to. This is a stub until the function is compiled.
+	void* stub;   // The stub that compiles the function on its first call.
+	resolve::FunctionDecl* function;
+	LazyJit* jit;
+	FunctionCounter counter; // Used to find hot functions in tiered mode.
+	bool promoted;           // Set when the function has been queued for optimization.
+};
+
+/**
+ * Compiles each function separately when it is first called, so that startup time depends on the code that actually runs.
+ * Calls between functions go through a code pointer for each callee, which initially points to a small stub.
+ * The stub asks the JIT to generate and compile the function into its own module,
+ * patches the code pointer with the compiled function and then calls it.
+ *
+ * In tiered mode, functions are first compiled without optimizations and with counters for their calls and loop iterations.
+ * Once a function becomes hot, it is generated again and sent to a background thread as bitcode,
+ * which optimizes and compiles it in its own context and then patches the code pointer.
+ * Calls that are running already finish in the unoptimized code.
+ */
+struct LazyJit : FunctionTable {
+	LazyJit(ast::CompileContext& context, llvm::LLVMContext& llcontext, const CompileSettings& settings);
+	~LazyJit();
+
+	/// Creates the execution engine.
+	/// Returns false and sets the error message if no JIT is available for the host.
+	bool init(std::string& error);
+
+	/// Calls the provided entry function through a thunk with the C calling convention, compiling it first.
+	/// Returns false and sets the error message if the entry function could not be compiled.
+	bool run(resolve::FunctionDecl& entry, int& result, std::string& error);
+
+	void** getSlot(resolve::FunctionDecl& function) override;
+	FunctionCounter* getCounter(resolve::FunctionDecl& function) override;
+
+	/// Generates and compiles the function in the provided slot, unless this was done already.
+	/// Returns the address of the compiled function.
+	void* compile(JitSlot& slot);
+
+	/// Generates the function in the provided slot without instrumentation and queues it for optimization.
+	void promote(JitSlot& slot);
+
+	/// Returns the number of functions that have been compiled so far.
+	U32 getCompiledCount() const {return compiledCount;}
+
+	/// Returns the number of functions that have been replaced by optimized code so far.
+	U32 getOptimizedCount() const {return optimizedCount;}
+
+private:
+	/// A hot function that waits to be optimized.
+	struct TierJob {
+		JitSlot* slot;
+		std::string function;
+		std::string bitcode;
+	};
+
+	/// Optimizes queued functions until the JIT is destroyed.
+	void runOptimizer();
+
+	/// Creates a new module that code can be generated into.
+	std::unique_ptr<llvm::Module> createModule(const std::string& name);
+
+	/// Compiles the provided module and returns the address of a function in it.
+	void* addModule(std::unique_ptr<llvm::Module> module, const std::string& function);
+
+	/// Creates the stub that compiles the function in the provided slot when it is called.
+	void* createStub(JitSlot& slot);
+
+	std::string getStubName(resolve::FunctionDecl& function) {
+		return context.find(function.name).name + ".stub";
+	}
+
+	ast::CompileContext& context;
+	llvm::LLVMContext& llcontext;
+	const CompileSettings& settings;
+	std::unique_ptr<llvm::Module> initial;
+	std::unique_ptr<llvm::ExecutionEngine> engine;
+	Generator gen;
+	Tritium::Map<resolve::FunctionDecl*, JitSlot*> slots;
+	Pool<JitSlot> slotData{64u};
+	U32 compiledCount = 0;
+
+	// Tiered compilation state. The queue is shared with the optimizer thread.
+	// Jobs are created by the thread that runs the program and destroyed by the optimizer thread.
+	bool instrument = true;
+	std::thread optimizer;
+	std::mutex queueLock;
+	std::condition_variable queueSignal;
+	std::deque<TierJob*> queue;
+	SharedPool<TierJob> jobs{32u};
+	bool stopping = false;
+	std::atomic<U32> optimizedCount{0};
+};
+
+}} // namespace athena::gen
+
+#endif // Athena_Generate_jit_h
@@ -0,0 +1,66 @@
+
+#define __STDC_CONSTANT_MACROS
+#define __STDC_FORMAT_MACROS
+#define __STDC_LIMIT_MACROS
+
+#include <llvm/Pass.h>
+#include <llvm/IR/LegacyPassManager.h>
+#include <llvm/Analysis/InlineCost.h>
+#include <llvm/Analysis/TargetTransformInfo.h>
+#include <llvm/Transforms/IPO.h>
+#include <llvm/Transforms/IPO/AlwaysInliner.h>
+#include <llvm/Transforms/IPO/PassManagerBuilder.h>
+#include <llvm/Support/Timer.h>
+#include <llvm/Support/raw_ostream.h>
+#include "optimize.h"
+
+using namespace llvm;
+
+namespace athena {
+namespace gen {
+
+void optimize(llvm::Module& module, TargetMachine& target, const CompileSettings& settings) {
+	// Passes are only timed while this is set. It is global state, so it is left alone unless timing is requested,
+	// which is never the case when modules are optimized on multiple threads.
+	if(settings.timePasses) TimePassesIsEnabled = true;
+
+	PassManagerBuilder builder;
+	builder.OptLevel = settings.optLevel;
+	builder.SizeLevel = 0;
+
+	// At O0 nothing is optimized, which keeps each variable in its alloca for debugging.
+	// At O1 only functions that must be inlined are, while O2 and higher use the normal inlining heuristics.
+	if(settings.optLevel >= 2) {
+		auto params = getInlineParams(settings.optLevel, 0);
+		builder.Inliner = createFunctionInliningPass(params);
+	} else if(settings.optLevel == 1) {
+		builder.Inliner = createAlwaysInlinerLegacyPass();
+	}
+
+	builder.LoopVectorize = settings.optLevel >= 2;
+	builder.SLPVectorize = settings.optLevel >= 2;
+
+	// Without the target, the vectorizers assume that there are no vector registers.
+	legacy::FunctionPassManager functionPasses{&module};
+	legacy::PassManager modulePasses;
+	functionPasses.add(createTargetTransformInfoWrapperPass(target.getTargetIRAnalysis()));
+	modulePasses.add(createTargetTransformInfoWrapperPass(target.getTargetIRAnalysis()));
+	builder.populateFunctionPassManager(functionPasses);
+	builder.populateModulePassManager(modulePasses);
+
+	// The function passes clean up each function before the module passes run on the whole program.
+	functionPasses.doInitialization();
+	for(auto& f : module) {
+		if(!f.isDeclaration()) functionPasses.run(f);
+	}
+	functionPasses.doFinalization();
+
+	modulePasses.run(module);
+
+	if(settings.timePasses) {
+		TimerGroup::printAll(errs());
+		TimePassesIsEnabled = false;
+	}
+}
+
+}} // namespace athena::gen
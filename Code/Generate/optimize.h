@@ -0,0 +1,18 @@
+#ifndef Athena_Generate_optimize_h
+#define Athena_Generate_optimize_h
+
+#include <llvm/IR/Module.h>
+#include <llvm/Target/TargetMachine.h>
+#include "../General/compiler.h"
+
+namespace athena {
+namespace gen {
+
+/// Runs the function and module optimization pipelines for the optimization level in the provided settings.
+/// The passes use the target to decide which instructions are available and what they cost, such as the width of vectors.
+/// If pass timing is enabled, a report of the time spent in each pass is printed afterwards.
+void optimize(llvm::Module& module, llvm::TargetMachine& target, const CompileSettings& settings);
+
+}} // namespace athena::gen
+
+#endif // Athena_Generate_optimize_h
@@ -74,9 +74,17 @@ struct CompileContext {
     }
 
     Id addUnqualifiedName(const char* chars, Size count) {
-        Qualified q;
-        q.name = std::string(chars, count);
-        return addName(&q);
+        // This produces the same id as addName, but only creates the name if it doesn't exist yet.
+        Hasher h;
+        h.addData(chars, count);
+        Id id = (U32)h;
+
+        Qualified* q;
+        if(!names.addGet(id, q)) {
+            new (q) Qualified;
+            q->name.assign(chars, count);
+        }
+        return id;
     }
 
     Id addName(Qualified* q) {
@@ -38,22 +38,6 @@ inline Literal toStringLiteral(Id name) {
 	return l;
 }
 
-void Parser::parseModule() {
-	IndentLevel level{token, lexer};
-	parseDecl();
-	while(token == Token::EndOfStmt) {
-		eat();
-		parseDecl();
-	}
-
-	if(token != Token::EndOfBlock) {
-		error("Expected end of statement block.");
-	}
-
-	level.end();
-	eat();
-}
-
 void Parser::parseDecl() {
 	/*
 	 * decl			→	fundecl
@@ -34,7 +34,37 @@ struct Parser {
 
 	Parser(CompileContext& context, Diagnostics& diag, Module& module, const char* text) : module(module), diag(diag), lexer(context, diag, text, &token), buffer(4*1024*1024) {lexer.next();}
 
-	void parseModule();
+	void parseModule() {parseModule([] {});}
+
+	/// Parses the module, calling the provided function after each top-level declaration has been added to it.
+	/// This allows later compilation phases to run while the rest of the module is being parsed.
+	template<class F> void parseModule(F&& onDecl) {
+		IndentLevel level{token, lexer};
+		parseDecl();
+		onDecl();
+		while(token == Token::EndOfStmt) {
+			eat();
+			parseDecl();
+			onDecl();
+		}
+
+		if(token != Token::EndOfBlock) {
+			error("Expected end of statement block.");
+		}
+
+		level.end();
+		eat();
+	}
+
+	/// Releases the memory used by every declaration parsed so far.
+	/// Nothing may refer to these declarations afterwards.
+	void releaseDecls() {
+		module.declarations.clear();
+		buffer.clear();
+	}
+
+	/// Returns the amount of memory used by the declarations that were parsed since the last release.
+	Size getUsedMemory() {return buffer.getUsed();}
 	void parseDecl();
 	Decl* parseFunDecl();
 	void parseDataDecl();
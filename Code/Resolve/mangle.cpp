@@ -4,71 +4,146 @@
 namespace athena {
 namespace resolve {
 
-std::string Mangler::mangle(Function* function) {
+/*
+ * Names are mangled according to the Itanium C++ ABI where possible, so that they can be demangled by existing tools.
+ * Types that do not exist in C++ use the following extensions:
+ *  - tuples are mangled as 'X', followed by each field and 'E'. Named fields are preceded by their source name.
+ *  - maps are mangled as 'M' followed by the key and value types.
+ *  - lambdas are mangled as 'Ul' followed by the mangled name of their function.
+ */
+
+const std::string& Mangler::mangle(Function* function) {
 	string.clear();
-	string << "_Z";
+	string += "_Z";
 
-	auto name = context.find(function->name);
-	mangleQualifier(&name);
+	mangleQualifier(&context.find(function->name));
 	if(function->scope.parent && function->scope.parent->function) {
-		string << '$';
-		name = context.find(function->scope.parent->function->name);
-		mangleQualifier(&name);
+		string += '$';
+		mangleQualifier(&context.find(function->scope.parent->function->name));
 	}
 
 	for(auto a : function->arguments) {
 		mangleType(a->type);
 	}
-	return string.str();
+	return string;
 }
 
 Id Mangler::mangleId(Function* function) {
-	return context.addUnqualifiedName(mangle(function));
+	auto& name = mangle(function);
+	return context.addUnqualifiedName(name.c_str(), name.length());
 }
 
 void Mangler::mangleQualifier(ast::Qualified* qualified) {
-	string << "N";
-	auto name = qualified->name;
+	string += 'N';
 	auto q = qualified->qualifier;
 	while(q) {
-		string << q->name.length();
-        string << q->name;
+		mangleName(q->name);
 		q = q->qualifier;
 	}
 
-	string << name.length();
-    string << name;
-	string << 'E';
+	mangleName(qualified->name);
+	string += 'E';
+}
+
+void Mangler::mangleName(const std::string& name) {
+	string += std::to_string(name.length());
+	string += name;
 }
 
 void Mangler::mangleType(Type* type) {
-	if(type->isUnit())
-		string << 'v';
-	else if(type->isPrimitive())
-		mangleType(((PrimType*)type)->type);
-	else if(type->isPointer())
-		mangleType((PtrType*)type);
-	else if(type->isVariant())
-		mangleType((VarType*)type);
+	// Generic types may be solved later, so their mangling cannot be cached.
+	if(type->isGeneric()) {
+		string += 'T';
+		if(auto index = ((GenType*)type)->index) string += std::to_string(index - 1);
+		string += '_';
+		return;
+	}
+
+	// Aliases are equivalent to their contents.
+	if(type->isAlias()) {
+		mangleType(type->canonical);
+		return;
+	}
+
+	std::string* cached;
+	if(typeCache.addGet(type, cached)) {
+		string += *cached;
+		return;
+	}
+
+	// Mangle the type at the end of the buffer, and store that fragment.
+	auto start = string.length();
+	switch(type->kind) {
+		case Type::Unit:
+			string += 'v';
+			break;
+		case Type::Prim:
+			mangleType(((PrimType*)type)->type);
+			break;
+		case Type::Ptr:
+			mangleType((PtrType*)type);
+			break;
+		case Type::Var:
+			mangleType((VarType*)type);
+			break;
+		case Type::Tuple:
+			mangleType((TupleType*)type);
+			break;
+		case Type::Array:
+			string += "A_";
+			mangleType(((ArrayType*)type)->type);
+			break;
+		case Type::Map:
+			string += 'M';
+			mangleType(((MapType*)type)->from);
+			mangleType(((MapType*)type)->to);
+			break;
+		case Type::Lvalue:
+			string += 'R';
+			mangleType(type->canonical);
+			break;
+		case Type::App:
+			string += 'T';
+			string += std::to_string(((AppType*)type)->baseIndex);
+			string += '_';
+			break;
+		case Type::Lam:
+			string += "Ul";
+			mangleQualifier(&context.find(((LamType*)type)->fun.name));
+			break;
+		default:
+			// Unknown types only exist in programs with errors.
+			string += 'u';
+	}
+
+	new (cached) std::string(string, start);
 }
 
 void Mangler::mangleType(PrimitiveType type) {
-	static const char types[] = {
-        'x', 'i', 's', 'c',
-        'y', 'j', 't', 'h',
-        'd', 'f', 't', 'b'
+	static const char* types[] = {
+        "x", "i", "s", "c",
+        "y", "j", "t", "h",
+        "d", "f", "Dh", "b"
 	};
-	string << types[(Size)type];
+	string += types[(Size)type];
 }
 
 void Mangler::mangleType(const PtrType* type) {
-	string << 'P';
+	string += 'P';
 	mangleType(type->type);
 }
 
 void Mangler::mangleType(const VarType* type) {
-	auto name = context.find(type->name);
-	mangleQualifier(&name);
+	mangleQualifier(&context.find(type->name));
+}
+
+void Mangler::mangleType(const TupleType* type) {
+	string += 'X';
+	for(auto& f : type->fields) {
+		if(f.name) mangleName(context.find(f.name).name);
+		mangleType(f.type);
+	}
+	string += 'E';
 }
 
 }} // namespace athena::resolve
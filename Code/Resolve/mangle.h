@@ -1,7 +1,7 @@
 #ifndef Athena_Resolve_mangle_h
 #define Athena_Resolve_mangle_h
 
-#include <sstream>
+#include <string>
 #include "../Parse/parser.h"
 #include "resolve_ast.h"
 
@@ -12,7 +12,8 @@ struct Mangler {
 	Mangler(ast::CompileContext& context) : context(context) {}
 
 	/// Mangles the name of the provided function.
-	std::string mangle(Function* function);
+	/// The returned string is only valid until the next call.
+	const std::string& mangle(Function* function);
 
 	/// Mangles a function name to a name id.
 	Id mangleId(Function* function);
@@ -25,10 +26,18 @@ struct Mangler {
 	void mangleType(PrimitiveType type);
 	void mangleType(const PtrType* type);
 	void mangleType(const VarType* type);
+	void mangleType(const TupleType* type);
 
 private:
+	void mangleName(const std::string& name);
+
 	ast::CompileContext& context;
-	std::ostringstream string;
+
+	// The buffer each name is built in. This is reused between calls to avoid allocations.
+	std::string string;
+
+	// The mangled fragment of each type that was mangled before.
+	Tritium::Map<Type*, std::string> typeCache{64};
 };
 
 }} // namespace athena::resolve
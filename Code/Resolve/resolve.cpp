@@ -8,9 +8,9 @@ Resolver::Resolver(ast::CompileContext& context, ast::Module& source) :
 	context(context), source(source), buffer(4*1024*1024) {}
 
 Module* Resolver::resolve() {
-	initPrimitives();
-	auto module = build<Module>();
-	module->name = source.name;
+	// Declarations outside of functions can use temporary data as well.
+	Tritium::ScratchScope scratchScope{scratch};
+	auto module = createModule();
 
     /*
      * We need to do two passes here.
@@ -21,98 +21,135 @@ Module* Resolver::resolve() {
 
     // Perform the declaration pass.
     for(auto decl : source.declarations) {
-		if(decl->kind == ast::Decl::Function) {
-			// Create a linked list of functions with the same name.
-			auto name = ((ast::FunDecl*)decl)->name;
-			FunctionDecl** f;
-			if(!module->functions.addGet(name, f)) *f = nullptr;
-			auto fun = *f;
-			*f = build<Function>(name, (ast::FunDecl*)decl);
-			(*f)->sibling = fun;
-		} else if(decl->kind == ast::Decl::Foreign) {
-			auto fdecl = (ast::ForeignDecl*)decl;
-			if(fdecl->type->kind == ast::Type::Fun) {
-				auto name = fdecl->importedName;
-				FunctionDecl **f;
-				if (!module->functions.addGet(name, f)) *f = nullptr;
-				auto fun = *f;
-				*f = build<ForeignFunction>(fdecl);
-				(*f)->sibling = fun;
+		declare(*module, decl);
+	}
+
+	// If the program has entry points, only the declarations reachable from them are resolved.
+	// Any functions and types they use are resolved lazily when they are referenced.
+	if(context.settings.entryPoints.size()) {
+		for(auto& entry : context.settings.entryPoints) {
+			auto name = context.addUnqualifiedName(entry);
+			if(auto f = module->functions.get(name)) {
+				for(auto fn = *f.force(); fn; fn = fn->sibling) {
+					resolveFunctionDecl(*module, *fn);
+				}
 			} else {
-				error("cannot handle foreign variable imports yet.");
+				error("entry point '%@' is not defined", entry.c_str());
 			}
+		}
+
+		return module;
+	}
+
+	resolveModule(*module);
+	return module;
+}
+
+Module* Resolver::createModule() {
+	initPrimitives();
+	auto module = build<Module>();
+	module->name = source.name;
+	return module;
+}
+
+FunctionDecl* Resolver::declare(Module& module, ast::Decl* decl) {
+	if(decl->kind == ast::Decl::Function) {
+		// Create a linked list of functions with the same name.
+		auto name = ((ast::FunDecl*)decl)->name;
+		FunctionDecl** f;
+		if(!module.functions.addGet(name, f)) *f = nullptr;
+		auto fun = *f;
+		*f = build<Function>(name, (ast::FunDecl*)decl);
+		(*f)->sibling = fun;
+		return *f;
+	} else if(decl->kind == ast::Decl::Foreign) {
+		auto fdecl = (ast::ForeignDecl*)decl;
+		if(fdecl->type->kind == ast::Type::Fun) {
+			auto name = fdecl->importedName;
+			FunctionDecl **f;
+			if (!module.functions.addGet(name, f)) *f = nullptr;
+			auto fun = *f;
+			*f = build<ForeignFunction>(fdecl);
+			(*f)->sibling = fun;
+			return *f;
 		} else {
-			// Type names have to be unique - give an error and ignore any repeated definitions.
-			Id name;
-			if(decl->kind == ast::Decl::Type) {
-				name = ((ast::TypeDecl*)decl)->type->name;
-			} else {
-				assert(decl->kind == ast::Decl::Data);
-				name = ((ast::DataDecl*)decl)->type->name;
-			}
+			error("cannot handle foreign variable imports yet.");
+			return nullptr;
+		}
+	}
 
-			Type** type;
-			if(module->types.addGet(name, type)) {
-				// This type was already declared in this scope.
-				// Ignore the type that was defined last.
-				error("redefinition of '%@'", context.find(name).name);
-			} else {
-				// Insert the unresolved type.
-				if(decl->kind == ast::Decl::Type) {
-					*type = build<AliasType>(name, (ast::TypeDecl*)decl, *module);
-				} else if(decl->kind == ast::Decl::Data) {
-					auto t = build<VarType>(name, (ast::DataDecl*)decl, *module);
-
-					// The constructors can be declared here, but are resolved later.
-					auto con = ((ast::DataDecl*)decl)->constrs;
-					bool isEnum = true;
-					U32 index = 0;
-					while(con) {
-						if(con->item->types) isEnum = false;
-						VarConstructor* constr;
-						if(module->constructors.addGet(con->item->name, constr)) {
-							// This constructor was already declared in this scope.
-							// Ignore the constructor that was defined last.
-							error("redefinition of type constructor '%@'", context.find(name).name);
-						} else {
-							new (constr) VarConstructor{con->item->name, index, t, con->item->types};
-							t->list << constr;
-						}
-						con = con->next;
-						index++;
-					}
-					t->isEnum = isEnum;
-					t->selectorBits = t->list.size() ? findLastBit(t->list.size() - 1) + 1 : 0;
-
-					assert(t->list.size() >= 1);
-					*type = t;
+	// Type names have to be unique - give an error and ignore any repeated definitions.
+	Id name;
+	if(decl->kind == ast::Decl::Type) {
+		name = ((ast::TypeDecl*)decl)->type->name;
+	} else {
+		assert(decl->kind == ast::Decl::Data);
+		name = ((ast::DataDecl*)decl)->type->name;
+	}
+
+	Type** type;
+	if(module.types.addGet(name, type)) {
+		// This type was already declared in this scope.
+		// Ignore the type that was defined last.
+		error("redefinition of '%@'", context.find(name).name);
+	} else {
+		// Insert the unresolved type.
+		if(decl->kind == ast::Decl::Type) {
+			*type = build<AliasType>(name, (ast::TypeDecl*)decl, module);
+		} else if(decl->kind == ast::Decl::Data) {
+			auto t = build<VarType>(name, (ast::DataDecl*)decl, module);
+
+			// The constructors can be declared here, but are resolved later.
+			auto con = ((ast::DataDecl*)decl)->constrs;
+			bool isEnum = true;
+			U32 index = 0;
+			while(con) {
+				if(con->item->types) isEnum = false;
+				VarConstructor** constr;
+				if(module.constructors.addGet(con->item->name, constr)) {
+					// This constructor was already declared in this scope.
+					// Ignore the constructor that was defined last.
+					error("redefinition of type constructor '%@'", context.find(name).name);
 				} else {
-					assert("Not implemented" == 0);
+					*constr = build<VarConstructor>(con->item->name, index, t, con->item->types);
+					t->list << *constr;
 				}
+				con = con->next;
+				index++;
 			}
+			t->isEnum = isEnum;
+			t->selectorBits = t->list.size() ? findLastBit(t->list.size() - 1) + 1 : 0;
+
+			assert(t->list.size() >= 1);
+			*type = t;
+		} else {
+			assert("Not implemented" == 0);
 		}
 	}
 
+	return nullptr;
+}
+
+void Resolver::resolveModule(Module& module) {
+	Tritium::ScratchScope scratchScope{scratch};
+
     // Perform the resolve pass. All defined names in this scope are now available.
 	// Symbols may be resolved lazily when used by other symbols,
 	// so we just skip those that are already defined.
+	// Alias types are completely replaced by their contents, since they are equivalent.
     modify([=](Id name, Type*& t) {
-		if(t->kind == Type::Alias) {
-			// Alias types are completely replaced by their contents, since they are equivalent.
-            auto a = (AliasType*)t;
-            if(a->astDecl) t = resolveAlias(a);
-        } else if(t->kind == Type::Var) {
-			// This is valid, since variants have at least one constructor.
-			auto a = (VarType*)t;
-            if(a->astDecl) resolveVariant(a);
-        }
-	}, module->types);
+		t = lazyResolve(t);
+	}, module.types);
 
-    walk([=](Id name, FunctionDecl* f) {
-        resolveFunctionDecl(*module, *f);
-    }, module->functions);
+    // Overloads that are never called still need to be resolved, since each of them is generated.
+    walk([&](Id name, FunctionDecl* f) {
+        for(; f; f = f->sibling) {
+            resolveFunctionDecl(module, *f);
+        }
+    }, module.functions);
 
-	return module;
+	// Every declaration that was waiting for its dependencies has been resolved now.
+	pendingDecls.clear();
 }
 
 Field Resolver::resolveField(ScopeRef scope, Type* container, U32 index, ast::Field& field) {
@@ -13,12 +13,23 @@ namespace athena {
 namespace resolve {
 
 typedef Tritium::Map<Id, PrimitiveOp> PrimOpMap;
+typedef Array<FunctionDecl*, Tritium::ScratchAllocator> CalleeList;
+
+// Conditions collected while resolving patterns. These are copied into the if-expression that tests them.
+typedef Array<IfCond, Tritium::ScratchAllocator> PatternConds;
+
+// Generic types with constraints that are solved when the function that queued them is finished.
+typedef Array<GenType*, Tritium::ScratchAllocator> InferQueue;
 
 struct TypeManager {
     TypeManager() {
 		unknownType.resolved = false;
         for(int i=0; i < (int)PrimitiveType::TypeCount; i++) {
             prims.push(PrimType{(PrimitiveType)i});
+
+            // The types were copied into the array, so they have to refer to their final location.
+            prims[i].canonical = &prims[i];
+            prims[i].hash = structuralHash(Type::Prim, (U32)i);
         }
 
         stringType = getPtr(getU8());
@@ -40,6 +51,7 @@ struct TypeManager {
         if(!arrays.addGet(content, type)) {
 			new(type) ArrayType{content};
 			type->resolved = content->resolved;
+			type->hash = structuralHash(Type::Array, content->hash);
 		}
 
         return type;
@@ -50,60 +62,53 @@ struct TypeManager {
 		if(!ptrs.addGet(content, type)) {
 			new(type) PtrType{content};
 			type->resolved = content->resolved;
+			type->hash = structuralHash(Type::Ptr, content->hash);
 		}
 
 		return type;
 	}
 
-	bool getTuple(U32 hash, TupleType*& type) {
-        return tuples.addGet(hash, type);
-	}
-
+	/// Returns the unique tuple type with the provided fields.
+	/// Tuples are interned structurally, so two tuple types are equal if and only if they are the same pointer.
 	Type* getTuple(const FieldList& fields) {
-		Hasher h;
-		for(auto& f : fields) {
-			h.add(f.type);
-			if(f.name) h.add(f.name);
+		auto hash = tupleHash(fields);
+		TupleType** bucket;
+		if(tuples.addGet(hash, bucket)) {
+			// Check each tuple with this hash for an exact match.
+			for(auto t = *bucket; t; t = t->next) {
+				if(sameFields(t->fields, fields)) return t;
+			}
+		} else {
+			*bucket = nullptr;
 		}
 
-		// Check if this kind of tuple has been used already.
-		TupleType* result = nullptr;
-		if(!getTuple((Id)h, result)) {
-			// Otherwise, create the type.
-			new (result) TupleType;
-			bool resolved = true;
-            result->fields.reserve(fields.size());
-            for(auto& f : fields) {
-                if(!f.type->resolved) resolved = false;
-                result->fields << f;
-            }
-            result->resolved = resolved;
+		// Otherwise, create the type.
+		auto result = tupleData.create();
+		bool resolved = true;
+		result->fields.reserve(fields.size());
+		U32 i = 0;
+		for(auto& f : fields) {
+			if(!f.type->resolved) resolved = false;
+			result->fields << Field{f.name, i, f.type, result, f.content, f.constant};
+			i++;
 		}
 
+		result->resolved = resolved;
+		result->hash = hash;
+		result->next = *bucket;
+		*bucket = result;
 		return result;
 	}
 
 	Type* getTuple(const TypeList& types) {
-		Hasher h;
-		for(auto t : types) h.add(t);
-
-		// Check if this kind of tuple has been used already.
-		TupleType* result = nullptr;
-		if(!getTuple((Id)h, result)) {
-			// Otherwise, create the type.
-			new (result) TupleType;
-			bool resolved = true;
-            result->fields.reserve(types.size());
-            U32 i = 0;
-            for(auto& t : types) {
-                if(!t->resolved) resolved = false;
-                result->fields << Field{0, i, t, result, nullptr, true};
-                i++;
-            }
-			result->resolved = resolved;
+		FieldList fields((U32)types.size());
+		U32 i = 0;
+		for(auto t : types) {
+			fields << Field{0, i, t, nullptr, nullptr, true};
+			i++;
 		}
 
-		return result;
+		return getTuple(fields);
 	}
 
 	Type* getLV(Type* t) {
@@ -111,6 +116,7 @@ struct TypeManager {
         if(!lvalues.addGet(t, type)) {
             new(type) LVType(t);
             type->resolved = t->resolved;
+            type->hash = structuralHash(Type::Lvalue, t->hash);
         }
 
         return type;
@@ -122,11 +128,40 @@ struct TypeManager {
 		return t->canonical;
 	}
 
+	static U32 structuralHash(Type::Kind kind, U32 content) {
+		Hasher h;
+		h.add((U32)kind);
+		h.add(content);
+		return h.get();
+	}
+
+	static U32 tupleHash(const FieldList& fields) {
+		Hasher h;
+		h.add((U32)Type::Tuple);
+		for(auto& f : fields) {
+			h.add(f.type->hash);
+
+			// Include the name to ensure that different tuples with the same memory layout are not exactly the same.
+			h.add(f.name);
+		}
+		return h.get();
+	}
+
+	static bool sameFields(const FieldList& a, const FieldList& b) {
+		if(a.size() != b.size()) return false;
+		for(U32 i = 0; i < a.size(); i++) {
+			// Field types are interned as well, so comparing pointers is enough here.
+			if(a[i].type != b[i].type || a[i].name != b[i].name || a[i].constant != b[i].constant) return false;
+		}
+		return true;
+	}
+
     ArrayF<PrimType, (Size)PrimitiveType::TypeCount> prims;
     Tritium::Map<Id, Type*> primMap; // Maps from ast type name to type.
     Tritium::Map<Type*, ArrayType> arrays;
     Tritium::Map<Type*, PtrType> ptrs;
-    Tritium::Map<Id, TupleType> tuples;
+    Tritium::Map<U32, TupleType*> tuples; // Maps from a structural hash to the chain of tuples with that hash.
+    Pool<TupleType> tupleData{32u};
     Tritium::Map<Type*, LVType> lvalues;
 
 	Type* stringType;
@@ -138,6 +173,41 @@ struct Resolver {
 	Resolver(ast::CompileContext& context, ast::Module& source);
 
 	Module* resolve();
+
+	/// Creates the module that the declarations of the source module are added to.
+	Module* createModule();
+
+	/// Adds a top-level declaration to the module without resolving it.
+	/// @return The declared function, or null if the declaration is a type.
+	FunctionDecl* declare(Module& module, ast::Decl* decl);
+
+	/// Resolves each declaration in the module that has not been resolved yet.
+	void resolveModule(Module& module);
+
+	/**
+	 * Declares a newly parsed top-level declaration, and resolves each declaration that is ready.
+	 * A declaration is ready once every name it uses has been declared,
+	 * and none of the declarations with those names are waiting for names that are still missing.
+	 * This allows a module to be compiled while it is being parsed, without requiring declarations to be ordered.
+	 * Each function that was resolved is added to the provided list.
+	 */
+	void resolveStreaming(Module& module, ast::Decl* decl, Array<FunctionDecl*>& resolved);
+
+	/// Records a function lookup made while resolving a streamed declaration, together with the overloads that existed at that point.
+	/// The callee is null if the call is created before its argument types are known.
+	void recordLookup(ScopeRef scope, Id name, ExprList* args, FunctionDecl* callee);
+
+	/// Checks if a function overload that was declared after a streamed declaration was resolved would have changed one of its calls.
+	/// This must be done after the module has been resolved completely.
+	/// @return The name of the first function with such an overload, or 0 if there is none.
+	Id findLateOverload(Module& module);
+
+	/// Checks if the source declarations can be released.
+	/// This is the case if no declaration is waiting for its dependencies, and no resolved data refers to the source.
+	bool canReleaseSource() {return pendingDecls.size() == 0 && !sourcePinned;}
+
+	/// Checks if the provided name refers to a declaration in the module or a built-in type or operator.
+	bool isDeclared(Module& module, Id name);
 	bool resolveFunctionDecl(Scope& scope, FunctionDecl& fun);
 	bool resolveFunction(Scope& scope, Function& fun);
 	bool resolveForeignFunction(Scope& scope, ForeignFunction& fun);
@@ -169,7 +239,7 @@ struct Resolver {
 	Type* resolveVariant(VarType* type);
 
 	/// Adds to a list of conditions that must be true.
-	void resolvePattern(Scope& scope, ExprRef pivot, ast::Pattern& pat, IfConds& conds);
+	void resolvePattern(Scope& scope, ExprRef pivot, ast::Pattern& pat, PatternConds& conds);
 
     /// Resolves a binary operation on two primitive types.
     /// *lhs* and *rhs* must be primitives.
@@ -203,11 +273,48 @@ struct Resolver {
 	void constrain(Type* type, const Constraint&& c);
 	void constrain(Type* type, Type* c);
 
+	/// Unifies two types by binding any generic types they contain.
+	/// If the types are concrete, the first one must be implicitly convertible to the second.
+	/// @return True if the types could be unified.
+	bool unify(Type* a, Type* b);
+
+	/// Binds the root of a generic type set to the provided type, merging the sets if it is generic as well.
+	bool bind(GenType* type, Type* to);
+
+	/// Checks if the provided generic type is contained in a type.
+	bool occurs(GenType* type, Type* in);
+
+	/// Checks a single constraint against the concrete type it applies to.
+	bool solveConstraint(Type* type, Constraint& c);
+
+	/// Solves the constraints of each generic type in the queue.
+	void solveConstraints(InferQueue& queue);
+
+	/// Replaces each solved generic type inside the provided type with its solution.
+	Type* substitute(Type* type);
+
 	Type* getBinaryOpType(PrimitiveOp, PrimitiveType, PrimitiveType, Expr*&, Expr*&);
 	Type* getPtrOpType(PrimitiveOp, PtrType*, PrimitiveType);
 	Type* getPtrOpType(PrimitiveOp, PtrType*, PtrType*);
 	Type* getUnaryOpType(PrimitiveOp, PrimitiveType);
 
+	/// Tries to fold a primitive operation on constant operands into a literal of the provided type.
+	/// Operations with an undefined result, such as division by zero, are not folded.
+	Expr* foldPrimitiveOp(PrimitiveOp op, ExprRef lhs, ExprRef rhs, Type* type);
+	Expr* foldPrimitiveOp(PrimitiveOp op, ExprRef dst, Type* type);
+
+	/// Tries to evaluate a call to the provided function at compile time.
+	/// This fails for functions that are not pure or take too long to evaluate.
+	/// The result is cached, so each function is evaluated only once for the same argument values.
+	bool evaluate(Function& fun, ExprList* args, Literal& result);
+
+	/// Checks if the provided function always evaluates to the same constant, and sets its constant value if so.
+	void findConstant(Function& fun);
+
+	/// Creates a call to the provided function.
+	/// Calls to pure functions with constant arguments are evaluated directly.
+	Expr* createCall(FunctionDecl& fun, ExprList* args);
+
 	/// Creates a return of the provided expression.
 	Expr* createRet(ExprRef);
 
@@ -229,6 +336,7 @@ struct Resolver {
 	/// Creates an if-expression.
 	Expr* createIf(ExprRef cond, ExprRef then, Expr* otherwise, bool used);
 	Expr* createIf(IfConds&& cond, ExprRef then, Expr* otherwise, bool used, CondMode mode);
+	Expr* createIf(const PatternConds& conds, ExprRef then, Expr* otherwise, bool used, CondMode mode);
 
 	/// Creates a field-expression.
 	Expr* createField(ExprRef pivot, Field* field);
@@ -268,12 +376,26 @@ struct Resolver {
 	FunctionDecl* findFunction(ScopeRef scope, Id name, ExprList* args);
 
 	/// Checks if the provided function can potentially be called with the provided arguments.
+	/// Arguments with a type that is still being inferred can be passed to any parameter.
 	bool potentiallyCallable(FunctionDecl* fun, ExprList* args);
 
-	/// Finds the best matching function from the current potential callees list.
-	FunctionDecl* findBestMatch(ExprList* args);
+	/// Creates a call where some of the argument types are still being inferred.
+	/// If only a single function can be called, the arguments are unified with its parameters.
+	/// Otherwise, each argument type is constrained to be usable with a function of that name.
+	Expr* createGenericCall(ScopeRef scope, Id name, ExprList* args);
+
+	/// Checks if a function with the provided name takes a parameter of the provided type at the provided index.
+	bool hasFunctionParameter(ScopeRef scope, Id name, U32 index, Type* type);
 
-	/// Returns the number of implicit conversions needed to call this function with the provided arguments.
+	/// Returns the instance of a generic function for the concrete types of the provided arguments.
+	/// Instances are cached per function, so each set of argument types is resolved exactly once.
+	/// Returns null if the argument types are not concrete yet.
+	Function* instantiateFunction(Function& generic, ExprList* args);
+
+	/// Finds the best matching function from a list of potential callees.
+	FunctionDecl* findBestMatch(const CalleeList& callees, ExprList* args);
+
+	/// Returns the total cost of the implicit conversions needed to call this function with the provided arguments.
 	/// The function must be callable with these arguments.
 	U32 findImplicitConversionCount(FunctionDecl* f, ExprList* args);
 
@@ -324,6 +446,50 @@ struct Resolver {
 	ast::CompileContext& context;
 	ast::Module& source;
 	Tritium::StaticBuffer buffer;
+
+	// Temporary data that is only used while resolving a single function.
+	// Each function resolution releases everything it allocated here when it returns.
+	Tritium::ScratchBuffer scratch;
+
+	// Top-level declarations that are declared but not resolved yet, when resolving a module while it is being parsed.
+	// The names they use are only needed until they are resolved, so they are freed with the declaration instead of kept in the buffer.
+	struct PendingDecl {
+		ast::Decl* decl;
+		FunctionDecl* fun = nullptr; // Set if the declaration is a function.
+		Id name = 0;
+		Array<Id> constructors; // Only used if the declaration is a data type.
+		Array<Id> uses;
+		bool blocked = false;
+		bool deferred = false; // Set if resolving the declaration failed, in which case it is resolved with the rest of the module.
+	};
+
+	Array<PendingDecl> pendingDecls;
+
+	// A function resolved while resolving a single streamed declaration, and the source it was resolved from.
+	struct AttemptedFunction {
+		Function* fun;
+		ast::FunDecl* decl;
+	};
+
+	// Set while a streamed declaration is being resolved.
+	// If a function lookup fails, each of these functions is reset so that it can be resolved again later.
+	Array<AttemptedFunction>* attempt = nullptr;
+
+	// The number of function lookups that found no function to call.
+	U32 failedLookups = 0;
+
+	// A lookup of a function name made by a streamed declaration that was not reset.
+	struct StreamedLookup {
+		Id name;
+		FunctionDecl* overloads; // The newest top-level overload with this name when the lookup was made.
+		ExprList* args; // The arguments as they were when the lookup was made, since they are coerced or inferred afterwards.
+		FunctionDecl* callee;
+	};
+
+	Array<StreamedLookup> streamedLookups;
+
+	// Set once any resolved data refers to the source declarations, such as generic functions that are instantiated later.
+	bool sourcePinned = false;
     TypeManager types;
 	TypeCheck typeCheck;
 	EmptyExpr emptyExpr{types.getUnit()};
@@ -332,8 +498,24 @@ struct Resolver {
 	Function* currentFunction = nullptr;
 	Scope* currentScope = nullptr;
 
-	// This is used to accumulate potentially callable functions.
-	Array<FunctionDecl*> potentialCallees{32};
+	// The result of evaluating a function at compile time for a set of argument values.
+	struct Evaluation {
+		Function* fun;
+		Literal* args;
+		Literal result;
+		bool success;
+		Evaluation* next; // The next evaluation with the same hash.
+	};
+
+	// Maps from a hash of a function and its argument values to the chain of evaluations with that hash.
+	Tritium::Map<U32, Evaluation*> evaluations;
+
+	// Generic types with constraints that have to be solved against their type constraint.
+	// Each function being resolved has its own queue in the scratch buffer, which is null outside of functions.
+	InferQueue* inferQueue = nullptr;
+
+	// The number of calls in the function being resolved where the function to call depends on inferred argument types.
+	U32 genericCalls = 0;
 };
 
 }} // namespace athena::resolve
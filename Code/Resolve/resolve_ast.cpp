@@ -35,20 +35,20 @@ Variable* Scope::findLocalVar(Id name) {
 }
 
 template<class T>
-inline T* findHelper(Scope* scope, Tritium::Map<Id, T> Scope::*map, Id name) {
+inline T findHelper(Scope* scope, Tritium::PersistentMap<Id, T> Scope::*map, Id name) {
     // Type names are unique, although a generic type may have specializations.
     // Generic types are handled separately.
     while(scope) {
         // Even if the type name exists, it may not have been resolved yet.
         // This is handled by the caller.
-        if(auto t = (scope->*map).get(name)) return t.force();
+        if(auto t = (scope->*map).get(name)) return *t.force();
         scope = scope->parent;
     }
 
     return nullptr;
 }
 
-Type* Scope::findType(Id name) { auto t = findHelper(this, &Scope::types, name); return t ? *t : nullptr; }
+Type* Scope::findType(Id name) { return findHelper(this, &Scope::types, name); }
 VarConstructor* Scope::findConstructor(Id name) { return findHelper(this, &Scope::constructors, name); }
 
 bool Scope::hasVariables() {
@@ -3,6 +3,8 @@
 
 #include "../Parse/ast.h"
 #include "../General/array.h"
+#include "../General/hash.h"
+#include "../General/hamt.h"
 
 namespace athena {
 namespace resolve {
@@ -15,6 +17,7 @@ struct Scope;
 struct Function;
 struct FunctionDecl;
 struct Expr;
+struct LitExpr;
 struct Alt;
 struct Type;
 struct Resolver;
@@ -25,14 +28,15 @@ typedef FunctionDecl& FuncRef;
 typedef Expr& ExprRef;
 
 typedef ast::ASTList<Expr*> ExprList;
-typedef Array<Variable*> VarList;
+typedef ArrayS<Variable*, 4> VarList;
 typedef Array<Function*> FunList;
 typedef Array<Type*> TypeList;
 typedef ast::ASTList<Scope*> ScopeList;
 typedef ast::ASTList<Alt*> AltList;
-typedef Tritium::Map<Id, Type*> TypeMap;
-typedef Tritium::Map<Id, VarConstructor> ConMap;
-typedef Tritium::Map<Id, FunctionDecl*> FunMap;
+// Scope maps are persistent, so that the declarations of a scope can be kept as a snapshot in O(1).
+typedef Tritium::PersistentMap<Id, Type*> TypeMap;
+typedef Tritium::PersistentMap<Id, VarConstructor*> ConMap;
+typedef Tritium::PersistentMap<Id, FunctionDecl*> FunMap;
 typedef ast::ForeignConvention ForeignConvention;
 
 struct VarConstructor {
@@ -149,8 +153,29 @@ struct Function : FunctionDecl {
 	// This is true as long as the function contains any generic parameters or return type.
 	// Generic functions must be instantiated before they can be called normally.
 	bool generic = false;
+
+	// If this function is generic, this is the source declaration that instances are resolved from.
+	ast::FunDecl* genericDecl = nullptr;
+
+	// If this function is generic, this contains each instance that was created from it so far.
+	FunList instances;
+
+	// If this is an instance of a generic function, this is the function it was created from.
+	Function* instanceOf = nullptr;
+
+	// If this is an instance of a generic function, these are the concrete argument types it was created for.
+	// This is empty for instances of functions without arguments, so use instanceOf to check for instances.
+	TypeList instanceArgs;
+
+	// If set, this function takes no arguments and always evaluates to this constant.
+	LitExpr* constant = nullptr;
 };
 
+/// Checks if the provided function is generic and has to be instantiated before it can be used.
+inline bool isGeneric(const FunctionDecl* f) {
+	return f->hasImpl && ((const Function*)f)->generic;
+}
+
 struct ForeignFunction : FunctionDecl {
 	ForeignFunction(ast::ForeignDecl* decl) :
 		FunctionDecl(decl->importedName, true, false), astType((ast::FunType*)decl->type), importName(decl->importName), cconv(decl->cconv) {}
@@ -259,6 +284,11 @@ struct Type {
 	// If not, it still contains generic data.
 	bool resolved = true;
 
+	// Cached hash of this type.
+	// Structural types (pointers, arrays, tuples, etc.) are interned by the TypeManager and hash their contents,
+	// other types hash their identity. Equal hashes do not imply equal types, but equal types always have equal hashes.
+	U32 hash;
+
 	bool isPointer() const {return kind == Ptr;}
     bool isPrimitive() const {return kind == Prim;}
 	bool isPtrOrPrim() const {return ((Size)kind & 0x10) != 0;}
@@ -277,6 +307,7 @@ struct Type {
 
 	Type(Kind kind) : kind(kind) {
 		canonical = this;
+		hash = ::hash((Size)this);
 	}
 };
 
@@ -319,12 +350,15 @@ struct Field {
 	bool constant;
 };
 
-typedef Array<Field> FieldList;
+typedef ArrayS<Field, 4> FieldList;
 
 struct TupleType : Type {
 	TupleType() : Type(Tuple) {}
 	FieldList fields;
 
+	// The next interned tuple with the same hash, if any.
+	TupleType* next = nullptr;
+
 	Field* findField(Id name) {
 		for(auto& i : fields) {
 			if(i.name == name) return &i;
@@ -333,7 +367,7 @@ struct TupleType : Type {
 	}
 };
 
-typedef Array<VarConstructor*> VarConstructorList;
+typedef ArrayS<VarConstructor*, 4> VarConstructorList;
 
 struct VarType : Type {
 	VarType(Id name, ast::DataDecl* astDecl, Scope& scope) :
@@ -378,11 +412,12 @@ struct Constraint {
 	struct FunC {
 		Id name; // The name of the function that has a parameter of this type.
 		U32 index; // The index the parameter should be at.
+		Scope* scope; // The scope the function is called from.
 	};
 	struct FieldC {
-		U32 index; // Set if index equals 0.
-		Id name;
-		Type* type; // The type of this field.
+		// The field being accessed, with its name or index and its type.
+		// The index and container are updated when the constraint is solved.
+		::athena::resolve::Field* target;
 	};
 
 	union {
@@ -392,20 +427,19 @@ struct Constraint {
 	Kind kind;
 };
 
-inline Constraint FunConstraint(Id name, U32 index) {
+inline Constraint FunConstraint(Id name, U32 index, Scope* scope) {
 	Constraint c;
 	c.kind = Constraint::Fun;
 	c.fun.name = name;
 	c.fun.index = index;
+	c.fun.scope = scope;
 	return c;
 }
 
-inline Constraint FieldConstraint(Size index, Id name, Type* type) {
+inline Constraint FieldConstraint(Field* target) {
 	Constraint c;
 	c.kind = Constraint::Field;
-	c.field.index = index;
-	c.field.name = name;
-	c.field.type = type;
+	c.field.target = target;
 	return c;
 }
 
@@ -444,6 +478,31 @@ struct GenType : Type {
 	::Array<Constraint> constraints;
 	Type* typeConstraint = nullptr;
 
+	/**
+	 * Generic types that have been unified with each other form a set in a union-find structure.
+	 * Each type points to a parent in its set, and the root of the set (which points to itself) represents it.
+	 * Only the root of a set has a valid constraint list and type constraint.
+	 */
+	GenType* parent = this;
+	U32 rank = 0;
+
+	// The number of constraints in the list that have been checked against the type constraint.
+	U32 solvedConstraints = 0;
+
+	/// Finds the root of the set this type belongs to, compressing the path on the way.
+	GenType* root() {
+		auto r = this;
+		while(r->parent != r) r = r->parent;
+
+		auto t = this;
+		while(t != r) {
+			auto next = t->parent;
+			t->parent = r;
+			t = next;
+		}
+		return r;
+	}
+
 	/**
 	 * The index of a generic type is related to a possible type containing it.
 	 * It refers to the index of the generic parameter this represents.
@@ -452,6 +511,17 @@ struct GenType : Type {
 	U32 index;
 };
 
+/// Returns the most specific type that is currently known for the provided type.
+/// For generic types that were unified with a concrete type, this is that type.
+inline Type* solvedType(Type* t) {
+	while(t->isGeneric()) {
+		auto r = ((GenType*)t)->root();
+		if(!r->typeConstraint) return r;
+		t = r->typeConstraint;
+	}
+	return t;
+}
+
 struct AppType : Type {
 	AppType(U32 baseIndex, ast::TypeList* apps) :
 			Type(App), baseIndex(baseIndex), apps(apps) {resolved = false;}
@@ -560,7 +630,7 @@ struct Expr {
 	Expr(Kind k, Type* type) : kind(k), type(type) {}
 };
 
-typedef Array<Expr*> Exprs;
+typedef ArrayS<Expr*, 4> Exprs;
 
 struct MultiExpr : Expr {
 	MultiExpr(Exprs&& es) : Expr(Multi, (*es.back())->type), es(std::move(es)) {}
@@ -613,7 +683,7 @@ struct IfCond {
  	Expr* cond;
 };
 
-typedef Array<IfCond> IfConds;
+typedef ArrayS<IfCond, 2> IfConds;
 
 enum class CondMode : Byte {
 	/// The then-branch is executed if all conditions are true.
@@ -694,7 +764,7 @@ struct ConstructArg {
 
 struct ConstructExpr : Expr {
 	ConstructExpr(Type* type, VarConstructor* con = nullptr) : Expr(Construct, type), con(con) {}
-	Array<ConstructArg> args;
+	ArrayS<ConstructArg, 4> args;
 
 	// Only set if the type is a variant.
 	VarConstructor* con;
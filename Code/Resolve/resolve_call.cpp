@@ -21,7 +21,8 @@ FunctionDecl* Resolver::findFunction(ScopeRef scope, ast::ExprRef callee, ExprLi
 }
 
 FunctionDecl* Resolver::findFunction(ScopeRef scope, Id name, ExprList* args) {
-	potentialCallees.clear();
+	// Resolving a potential callee can look up other functions, so each lookup needs its own list.
+	CalleeList potentialCallees{8};
 	bool identifierExists = false;
 
 	// Recursively search upwards through each scope.
@@ -55,11 +56,20 @@ FunctionDecl* Resolver::findFunction(ScopeRef scope, Id name, ExprList* args) {
 		else
 			error("use of undeclared identifier '%@'", n);
 
+		failedLookups++;
 		return nullptr;
 	}
 
 	// Find the best match and return it.
-	return findBestMatch(args);
+	auto fun = findBestMatch(potentialCallees, args);
+	if(attempt) recordLookup(scope, name, args, fun);
+
+	// Generic functions are specialized for the concrete argument types at each call site.
+	if(isGeneric(fun)) {
+		if(auto instance = instantiateFunction(*(Function*)fun, args)) return instance;
+	}
+
+	return fun;
 }
 
 bool Resolver::potentiallyCallable(FunctionDecl* fun, ExprList* args) {
@@ -68,8 +78,17 @@ bool Resolver::potentiallyCallable(FunctionDecl* fun, ExprList* args) {
 	auto fend = fun->arguments.end();
 	auto arg = args;
 	while(arg && farg != fend) {
+		// Generic parameters accept any type, unless they have been constrained to a specific type already.
 		// If any argument is incompatible, the function is not callable.
-		if(!typeCheck.compatible(*arg->item, (*farg)->type)) return false;
+		auto type = (*farg)->type;
+		if(!arg->item->type->resolved && solvedType(arg->item->type->canonical)->isGeneric()) {
+			// The argument type is unified with the parameter when the call is created.
+		} else if(type->isGeneric()) {
+			auto constraint = ((GenType*)type)->typeConstraint;
+			if(constraint && !typeCheck.compatible(*arg->item, constraint)) return false;
+		} else if(type->resolved && !typeCheck.compatible(*arg->item, type)) {
+			return false;
+		}
 
 		arg = arg->next;
 		farg = ++farg;
@@ -80,10 +99,24 @@ bool Resolver::potentiallyCallable(FunctionDecl* fun, ExprList* args) {
 }
 
 U32 Resolver::findImplicitConversionCount(FunctionDecl* f, ExprList* args) {
-	return 0;
+	U32 cost = 0;
+	auto arg = args;
+	for(auto a : f->arguments) {
+		// Generic parameters accept any argument without conversion.
+		if(a->type->resolved) {
+			auto& e = *arg->item;
+			auto c = typeCheck.findCoercion(e.type, a->type);
+			if(!c) {
+				if(auto l = findLiteral(e)) c = TypeCheck::findLiteralCoercion(l->literal.type, a->type);
+			}
+			cost += c.cost;
+		}
+		arg = arg->next;
+	}
+	return cost;
 }
 
-FunctionDecl* Resolver::findBestMatch(ExprList* args) {
+FunctionDecl* Resolver::findBestMatch(const CalleeList& potentialCallees, ExprList* args) {
 	// One function is a better match than the other if one of the following is true:
 	//  - The call needs less implicit conversions.
 	//  - The function is less generic.
@@ -97,13 +130,22 @@ FunctionDecl* Resolver::findBestMatch(ExprList* args) {
 	// For each function, check if it is better than the best one.
 	for(U32 i = 1; i < potentialCallees.size(); i++) {
 		// TODO: This should be the last match factor that is checked.
-		U32 convs = findImplicitConversionCount(potentialCallees[i], args);
+		auto f = potentialCallees[i];
+		U32 convs = findImplicitConversionCount(f, args);
 		if(convs < leastConversions) {
 			sameMatchCount = 0;
-			bestMatch = potentialCallees[i];
+			bestMatch = f;
 			leastConversions = convs;
 		} else if(convs == leastConversions) {
-			sameMatchCount++;
+			// Concrete functions are preferred over generic ones that would match just as well.
+			bool generic = isGeneric(f);
+			bool bestGeneric = isGeneric(bestMatch);
+			if(bestGeneric && !generic) {
+				sameMatchCount = 0;
+				bestMatch = f;
+			} else if(generic == bestGeneric) {
+				sameMatchCount++;
+			}
 		}
 	}
 
@@ -113,4 +155,67 @@ FunctionDecl* Resolver::findBestMatch(ExprList* args) {
 	return bestMatch;
 }
 
+Expr* Resolver::createGenericCall(ScopeRef scope, Id name, ExprList* args) {
+	// Find each function that could be called with these arguments.
+	CalleeList potentialCallees{8};
+	for(auto s = &scope; s; s = s->parent) {
+		if(auto fns = s->functions.get(name)) {
+			for(auto fn = *fns.force(); fn; fn = fn->sibling) {
+				resolveFunctionDecl(*s, *fn);
+				if(potentiallyCallable(fn, args)) potentialCallees << fn;
+			}
+		}
+	}
+
+	// If there is only one, the argument types must be compatible with its parameters.
+	if(potentialCallees.size() == 1) {
+		auto fun = potentialCallees[0];
+		if(attempt) recordLookup(scope, name, args, nullptr);
+
+		auto a = args;
+		for(auto p : fun->arguments) {
+			if(!p->type->resolved) {
+				// Generic parameters are bound when the callee is instantiated.
+			} else if(a->item->type->resolved) {
+				a->item = implicitCoerce(*a->item, p->type);
+			} else if(!unify(a->item->type, p->type)) {
+				error("argument type is incompatible with the parameter of '%@'", context.find(name).name);
+			}
+			a = a->next;
+		}
+
+		// Calls to concrete functions no longer depend on inference.
+		if(!isGeneric(fun)) return build<AppExpr>(*fun, args);
+	}
+
+	// Otherwise, the function is chosen when the argument types are known.
+	genericCalls++;
+	U32 i = 0;
+	for(auto a = args; a; a = a->next) {
+		if(!a->item->type->resolved) constrain(a->item->type, FunConstraint(name, i, &scope));
+		i++;
+	}
+
+	return build<GenAppExpr>(name, args, build<GenType>(0));
+}
+
+bool Resolver::hasFunctionParameter(ScopeRef scope, Id name, U32 index, Type* type) {
+	// Primitive operations are defined for each primitive and pointer type.
+	if(type->isPtrOrPrim() && (tryPrimitiveBinaryOp(name) || tryPrimitiveUnaryOp(name))) return true;
+
+	for(auto s = &scope; s; s = s->parent) {
+		if(auto fns = s->functions.get(name)) {
+			for(auto fn = *fns.force(); fn; fn = fn->sibling) {
+				resolveFunctionDecl(*s, *fn);
+				if(index >= fn->arguments.size()) continue;
+
+				auto p = fn->arguments[index]->type;
+				if(!p->resolved || typeCheck.compatible(type, p)) return true;
+			}
+		}
+	}
+
+	return false;
+}
+
 }} // namespace athena::resolve
@@ -30,6 +30,13 @@ Expr* Resolver::createIf(ExprRef cond, ExprRef then, Expr* otherwise, bool used)
     return createIf(IfConds{IfCond{nullptr, &cond}}, then, otherwise, used, CondMode::And);
 }
 
+Expr* Resolver::createIf(const PatternConds& conds, ExprRef then, Expr* otherwise, bool used, CondMode mode) {
+    // The pattern conditions are temporary, but the if-expression is part of the resolved tree.
+    IfConds ifConds((U32)conds.size());
+    for(auto& c : conds) ifConds << c;
+    return createIf(std::move(ifConds), then, otherwise, used, mode);
+}
+
 Expr* Resolver::createIf(IfConds&& conds, ExprRef then_, Expr* otherwise_, bool used, CondMode mode) {
     for(auto& c : conds) {
         if(c.cond) {
@@ -106,19 +106,18 @@ Expr* Resolver::resolveBinaryCall(Scope& scope, Id function, ExprRef lt, ExprRef
 
 	// If one of the arguments has an incomplete type, create a generic call.
 	if(!lt.type->resolved || !rt.type->resolved) {
-		constrain(lt.type, FunConstraint(function, 0));
-		constrain(rt.type, FunConstraint(function, 1));
-		return build<GenAppExpr>(function, args, build<GenType>(0));
+		return createGenericCall(scope, function, args);
 	}
 
 	// Otherwise, create a normal function call.
 	if(auto func = findFunction(scope, function, args)) {
 		args->item = implicitCoerce(*args->item, func->arguments[0]->type);
 		args->next->item = implicitCoerce(*args->next->item, func->arguments[1]->type);
-		return build<AppExpr>(*func, args);
+		return createCall(*func, args);
 	} else {
 		// No need for an error; this is done by findFunction.
-		return nullptr;
+		// The call is replaced by an empty value, so that resolving can continue with the rest of the function.
+		return build<EmptyExpr>(types.getUnit());
 	}
 }
 
@@ -138,17 +137,17 @@ Expr* Resolver::resolveUnaryCall(Scope& scope, Id function, ExprRef target) {
 
 	// If the argument has an incomplete type, create a generic call.
 	if(!target.type->resolved) {
-		constrain(target.type, FunConstraint(function, 0));
-		return build<GenAppExpr>(function, args, build<GenType>(0));
+		return createGenericCall(scope, function, args);
 	}
 
 	// Otherwise, create a normal function call.
 	if(auto func = findFunction(scope, function, args)) {
 		args->item = implicitCoerce(*args->item, func->arguments[0]->type);
-		return build<AppExpr>(*func, args);
+		return createCall(*func, args);
 	} else {
 		// No need for an error; this is done by findFunction.
-		return nullptr;
+		// The call is replaced by an empty value, so that resolving can continue with the rest of the function.
+		return build<EmptyExpr>(types.getUnit());
 	}
 }
 
@@ -187,15 +186,7 @@ Expr* Resolver::resolveCall(Scope& scope, ast::AppExpr& expr) {
 	// If the arguments contain an incomplete type, create a generic call.
 	if(!resolved) {
 		if(expr.callee->isVar()) {
-			auto name = ((ast::VarExpr*)expr.callee)->name;
-			auto a = args;
-			U32 i = 0;
-			while(a) {
-				constrain(a->item->type, FunConstraint(name, i));
-				a = a->next;
-				i++;
-			}
-			return build<GenAppExpr>(name, args, build<GenType>(0));
+			return createGenericCall(scope, ((ast::VarExpr*)expr.callee)->name, args);
 		} else {
 			assert("Not implemented" == 0);
 			return nullptr;
@@ -209,11 +200,11 @@ Expr* Resolver::resolveCall(Scope& scope, ast::AppExpr& expr) {
 			a->item = implicitCoerce(*a->item, b->type);
 			a = a->next;
 		}
-		return build<AppExpr>(*fun, args);
+		return createCall(*fun, args);
 	}
 
 	// No need for errors - each failure above this would print an error.
-	return nullptr;
+	return build<EmptyExpr>(types.getUnit());
 }
 
 Expr* Resolver::resolveLambda(Scope& scope, ast::LamExpr& expr) {
@@ -234,11 +225,11 @@ Expr* Resolver::resolveVar(Scope& scope, Id name) {
 		if(auto fun = findFunction(scope, name, nullptr)) {
 			// This is a function being called with zero arguments.
 			// TODO: Create a closure if the function actually takes more arguments.
-			return build<AppExpr>(*fun, nullptr);
+			return createCall(*fun, nullptr);
 		} else {
 			// No variable or function was found; we are out of luck.
 			error("could not find a function or variable named '%@'", context.find(name).name);
-			return nullptr;
+			return build<EmptyExpr>(types.getUnit());
 		}
 	}
 }
@@ -402,19 +393,30 @@ Expr* Resolver::resolveCoerce(Scope& scope, ast::CoerceExpr& expr) {
 Expr* Resolver::resolveField(Scope& scope, ast::FieldExpr& expr, ast::ExprList* args) {
 	auto target = resolveExpression(scope, expr.target, true);
 
+	// Field accesses on a type that is still being inferred constrain it to a type containing that field.
+	auto targetType = solvedType(target->type->canonical);
+	if(targetType->isGeneric() && expr.field->type == ast::Expr::Var && !args) {
+		auto name = ((ast::VarExpr*)expr.field)->name;
+		auto field = build<Field>(name, 0, build<GenType>(0), targetType, nullptr, false);
+		constrain(targetType, FieldConstraint(field));
+		return createField(*target, field);
+	}
+
 	// Check if this is a field or function call expression.
 	// For types without named fields, this is always a function call.
 	// For types with named fields, this is a field expression if the target is a VarExpr,
 	// and the type has a field with that name.
-	if(target->type->isTupleOrIndirect() && expr.field->type == ast::Expr::Var) {
+	// Targets with a type that was solved by inference are accessed like the solution.
+	auto type = target->type->isGeneric() ? targetType : target->type;
+	if(type->isTupleOrIndirect() && expr.field->type == ast::Expr::Var) {
 		TupleType* tupType;
-		if(target->type->isTuple()) {
-			tupType = (TupleType*)target->type;
-		} else if(target->type->isPointer()) {
-			tupType = (TupleType*)((PtrType*)target->type)->type;
+		if(type->isTuple()) {
+			tupType = (TupleType*)type;
+		} else if(type->isPointer()) {
+			tupType = (TupleType*)((PtrType*)type)->type;
 		} else {
-			assert(target->type->isLvalue());
-			tupType = (TupleType*)target->type->canonical;
+			assert(type->isLvalue());
+			tupType = (TupleType*)type->canonical;
 		}
 
 		if(auto f = tupType->findField(((ast::VarExpr*)expr.field)->name)) {
@@ -507,48 +509,32 @@ Expr* Resolver::resolveConstruct(Scope& scope, ast::ConstructExpr& expr) {
 }
 
 Expr* Resolver::resolveAnonConstruct(Scope& scope, ast::TupleConstructExpr& expr) {
-	// Generate a hash for the fields.
-	Hasher h;
+	FieldList fields;
 	auto f = expr.args;
 	auto con = build<ConstructExpr>(types.getUnknown());
 	U32 index = 0;
 	while(f) {
 		assert(f->item->defaultValue);
 		auto e = getRV(*resolveExpression(scope, f->item->defaultValue, true));
-		h.add(e->type);
-		if(f->item->name) h.add(f->item->name.force());
-
+		fields << Field{f->item->name ? f->item->name.force() : 0, index, e->type, nullptr, nullptr, true};
 		con->args << ConstructArg{index, *e};
 
 		index++;
 		f = f->next;
 	}
 
-	// Check if this kind of tuple has been used already.
-	TupleType* result = nullptr;
-	if(!types.getTuple((uint32_t)h, result)) {
-		// Otherwise, create the type.
-		new (result) TupleType;
-		U32 i = 0;
-		f = expr.args;
-		while(f) {
-			auto t = con->args[i].expr.type;
-			result->fields << Field{f->item->name ? f->item->name.force() : 0, i, t, result, nullptr, true};
-			f = f->next;
-			i++;
-		}
-	}
-	con->type = result;
+	// Tuples are interned, so this returns an existing type if the same tuple has been used already.
+	con->type = types.getTuple(fields);
 	return con;
 }
 
 Expr* Resolver::resolveAlt(Scope& scope, ExprRef pivot, ast::AltList* alt, bool used) {
 	if(alt) {
 		auto s = build<ScopedExpr>(scope);
-		IfConds conds;
+		PatternConds conds;
 		resolvePattern(s->scope, pivot, *alt->item->pattern, conds);
 		auto result = resolveExpression(s->scope, alt->item->expr, used);
-		s->contents = createIf(std::move(conds), *result, resolveAlt(scope, pivot, alt->next, used), used, CondMode::And);
+		s->contents = createIf(conds, *result, resolveAlt(scope, pivot, alt->next, used), used, CondMode::And);
 		s->type = result->type;
 		return s;
 	} else {
@@ -567,7 +553,7 @@ Expr* Resolver::resolveCase(Scope& scope, ast::CaseExpr& expr, bool used) {
 	}
 }
 
-void Resolver::resolvePattern(Scope& scope, ExprRef pivot, ast::Pattern& pat, IfConds& conds) {
+void Resolver::resolvePattern(Scope& scope, ExprRef pivot, ast::Pattern& pat, PatternConds& conds) {
 	switch(pat.kind) {
 		case ast::Pattern::Var: {
 			auto var = build<Variable>(((ast::VarPattern&)pat).var, pivot.type, scope, true);
@@ -0,0 +1,440 @@
+#include <cmath>
+#include "resolve.h"
+
+namespace athena {
+namespace resolve {
+
+/// Returns the number of bits in an integer primitive type.
+inline U32 intBits(PrimitiveType t) {
+	return 64u >> ((U32)t & 3);
+}
+
+inline bool isSigned(PrimitiveType t) {return category(t) == PrimitiveTypeCategory::Signed;}
+inline bool isInteger(PrimitiveType t) {return t < PrimitiveType::FirstFloat;}
+
+/// Wraps an integer value to the width of the provided type.
+/// Signed values are kept sign-extended and unsigned values zero-extended to 64 bits.
+inline U64 wrapInt(U64 v, PrimitiveType t) {
+	auto bits = intBits(t);
+	if(bits == 64) return v;
+
+	auto mask = (U64(1) << bits) - 1;
+	v &= mask;
+	if(isSigned(t) && (v >> (bits - 1))) v |= ~mask;
+	return v;
+}
+
+inline Literal intLiteral(U64 v) {
+	Literal l;
+	l.type = Literal::Int;
+	l.i = v;
+	return l;
+}
+
+inline Literal floatLiteral(double v, PrimitiveType t) {
+	Literal l;
+	l.type = Literal::Float;
+	l.f = t == PrimitiveType::F32 ? (double)(float)v : v;
+	return l;
+}
+
+inline Literal boolLiteral(bool v) {
+	Literal l;
+	l.type = Literal::Bool;
+	l.i = v ? 1 : 0;
+	return l;
+}
+
+/// Checks if a literal contains a value of the provided primitive type that can be folded.
+inline bool foldable(const Literal& l, PrimitiveType t) {
+	if(t == PrimitiveType::Bool) return l.type == Literal::Bool;
+	if(isInteger(t)) return l.type == Literal::Int;
+
+	// Half-precision values cannot be represented on the host.
+	return l.type == Literal::Float && t != PrimitiveType::F16;
+}
+
+/// Applies a binary operation to two constants of the provided primitive type.
+/// Operations with an undefined result (such as a division by zero) are not folded and left for runtime.
+static bool foldBinary(PrimitiveOp op, PrimitiveType t, const Literal& lhs, const Literal& rhs, Literal& out) {
+	if(!foldable(lhs, t) || !foldable(rhs, t)) return false;
+
+	if(t == PrimitiveType::Bool) {
+		bool a = lhs.i != 0, b = rhs.i != 0;
+		switch(op) {
+			case PrimitiveOp::And: out = boolLiteral(a && b); return true;
+			case PrimitiveOp::Or: out = boolLiteral(a || b); return true;
+			case PrimitiveOp::Xor: out = boolLiteral(a != b); return true;
+			case PrimitiveOp::CmpEq: out = boolLiteral(a == b); return true;
+			case PrimitiveOp::CmpNeq: out = boolLiteral(a != b); return true;
+			default: return false;
+		}
+	}
+
+	if(!isInteger(t)) {
+		double a = lhs.f, b = rhs.f;
+		switch(op) {
+			case PrimitiveOp::Add: out = floatLiteral(a + b, t); return true;
+			case PrimitiveOp::Sub: out = floatLiteral(a - b, t); return true;
+			case PrimitiveOp::Mul: out = floatLiteral(a * b, t); return true;
+			case PrimitiveOp::Div:
+				if(b == 0.0) return false;
+				out = floatLiteral(a / b, t); return true;
+			case PrimitiveOp::Rem:
+				if(b == 0.0) return false;
+				out = floatLiteral(std::fmod(a, b), t); return true;
+			case PrimitiveOp::CmpEq: out = boolLiteral(a == b); return true;
+			case PrimitiveOp::CmpNeq: out = boolLiteral(a != b); return true;
+			case PrimitiveOp::CmpGt: out = boolLiteral(a > b); return true;
+			case PrimitiveOp::CmpGe: out = boolLiteral(a >= b); return true;
+			case PrimitiveOp::CmpLt: out = boolLiteral(a < b); return true;
+			case PrimitiveOp::CmpLe: out = boolLiteral(a <= b); return true;
+			default: return false;
+		}
+	}
+
+	// Literals are not truncated when they are coerced, so normalize them first.
+	U64 a = wrapInt(lhs.i, t), b = wrapInt(rhs.i, t);
+	bool sign = isSigned(t);
+	auto sa = (I64)a, sb = (I64)b;
+	auto bits = intBits(t);
+
+	switch(op) {
+		case PrimitiveOp::Add: out = intLiteral(wrapInt(a + b, t)); return true;
+		case PrimitiveOp::Sub: out = intLiteral(wrapInt(a - b, t)); return true;
+		case PrimitiveOp::Mul: out = intLiteral(wrapInt(a * b, t)); return true;
+		case PrimitiveOp::Div:
+		case PrimitiveOp::Rem: {
+			if(b == 0) return false;
+
+			// The smallest signed value divided by -1 overflows.
+			if(sign && sb == -1 && a == wrapInt(U64(1) << (bits - 1), t)) return false;
+
+			U64 r;
+			if(op == PrimitiveOp::Div) r = sign ? (U64)(sa / sb) : a / b;
+			else r = sign ? (U64)(sa % sb) : a % b;
+			out = intLiteral(wrapInt(r, t));
+			return true;
+		}
+		case PrimitiveOp::Shl:
+			if(b >= bits) return false;
+			out = intLiteral(wrapInt(a << b, t)); return true;
+		case PrimitiveOp::Shr:
+			if(b >= bits) return false;
+			out = intLiteral(wrapInt(sign ? (U64)(sa >> b) : a >> b, t)); return true;
+		case PrimitiveOp::And: out = intLiteral(a & b); return true;
+		case PrimitiveOp::Or: out = intLiteral(a | b); return true;
+		case PrimitiveOp::Xor: out = intLiteral(wrapInt(a ^ b, t)); return true;
+		case PrimitiveOp::CmpEq: out = boolLiteral(a == b); return true;
+		case PrimitiveOp::CmpNeq: out = boolLiteral(a != b); return true;
+		case PrimitiveOp::CmpGt: out = boolLiteral(sign ? sa > sb : a > b); return true;
+		case PrimitiveOp::CmpGe: out = boolLiteral(sign ? sa >= sb : a >= b); return true;
+		case PrimitiveOp::CmpLt: out = boolLiteral(sign ? sa < sb : a < b); return true;
+		case PrimitiveOp::CmpLe: out = boolLiteral(sign ? sa <= sb : a <= b); return true;
+		default: return false;
+	}
+}
+
+/// Applies a unary operation to a constant of the provided primitive type.
+static bool foldUnary(PrimitiveOp op, PrimitiveType t, const Literal& in, Literal& out) {
+	if(!foldable(in, t)) return false;
+
+	if(op == PrimitiveOp::Neg) {
+		if(isInteger(t)) out = intLiteral(wrapInt(0 - wrapInt(in.i, t), t));
+		else if(t != PrimitiveType::Bool) out = floatLiteral(-in.f, t);
+		else return false;
+		return true;
+	} else if(op == PrimitiveOp::Not) {
+		if(t == PrimitiveType::Bool) out = boolLiteral(in.i == 0);
+		else if(isInteger(t)) out = intLiteral(wrapInt(~in.i, t));
+		else return false;
+		return true;
+	}
+
+	return false;
+}
+
+/// Converts a constant between two primitive types, as done by an implicit or explicit coercion.
+static bool foldCoerce(PrimitiveType from, PrimitiveType to, const Literal& in, Literal& out) {
+	if(!foldable(in, from) || to == PrimitiveType::F16) return false;
+
+	if(from == PrimitiveType::Bool) {
+		if(to == PrimitiveType::Bool) out = in;
+		else if(isInteger(to)) out = intLiteral(in.i);
+		else out = floatLiteral(in.i ? 1.0 : 0.0, to);
+		return true;
+	}
+
+	if(to == PrimitiveType::Bool) return false;
+
+	if(isInteger(from)) {
+		auto v = wrapInt(in.i, from);
+		if(isInteger(to)) out = intLiteral(wrapInt(v, to));
+		else out = floatLiteral(isSigned(from) ? (double)(I64)v : (double)v, to);
+		return true;
+	}
+
+	if(isInteger(to)) {
+		// Conversions of values that do not fit are undefined.
+		if(!(in.f > -9.2e18 && in.f < 9.2e18)) return false;
+		out = intLiteral(wrapInt((U64)(I64)in.f, to));
+	} else {
+		out = floatLiteral(in.f, to);
+	}
+	return true;
+}
+
+/**
+ * Evaluates resolved expressions at compile time.
+ * Only pure code is supported - anything that reads memory or calls foreign functions makes evaluation fail.
+ * Evaluation also fails when the call depth or number of evaluated expressions becomes too large,
+ * which protects the compiler against functions that do not terminate.
+ */
+struct Evaluator {
+	// Environments only exist during evaluation, so they are allocated from the scratch buffer.
+	using Env = Tritium::Map<Variable*, Literal, Tritium::Compare<Variable*>, Tritium::ScratchAllocator>;
+
+	static const U32 maxDepth = 64;
+	static const U32 maxSteps = 1 << 16;
+
+	bool call(Function& fun, const Literal* args, Literal& result) {
+		// Functions that are still being resolved cannot be evaluated yet.
+		if(!fun.expression || fun.astDecl) {
+			incomplete = true;
+			return false;
+		}
+
+		if(fun.generic || depth >= maxDepth) return false;
+		if(!fun.type->isPrimitive()) return false;
+
+		Env env;
+		for(U32 i = 0; i < fun.arguments.size(); i++) {
+			env.add(fun.arguments[i], args[i]);
+		}
+
+		depth++;
+		auto ok = eval(env, *fun.expression, result);
+		returned = false;
+		depth--;
+		return ok;
+	}
+
+	bool eval(Env& env, ExprRef e, Literal& out) {
+		if(++steps > maxSteps) return false;
+
+		switch(e.kind) {
+			case Expr::Lit: {
+				auto& l = ((LitExpr&)e).literal;
+				if(l.type == Literal::String || l.type == Literal::Char) return false;
+				out = l;
+				return true;
+			}
+			case Expr::Var: {
+				if(auto v = env.get(((VarExpr&)e).var)) {
+					out = *v.force();
+					return true;
+				}
+				return false;
+			}
+			case Expr::CoerceLV:
+				return eval(env, ((CoerceLVExpr&)e).src, out);
+			case Expr::Coerce: {
+				auto& src = ((CoerceExpr&)e).src;
+				auto from = src.type->canonical;
+				if(!from->isPrimitive() || !e.type->isPrimitive()) return false;
+
+				Literal l;
+				return eval(env, src, l) && foldCoerce(((PrimType*)from)->type, ((PrimType*)e.type)->type, l, out);
+			}
+			case Expr::AppP: {
+				auto& app = (AppPExpr&)e;
+				auto lhs = app.args->item;
+				auto type = lhs->type->canonical;
+				if(!type->isPrimitive()) return false;
+
+				Literal a;
+				if(!eval(env, *lhs, a)) return false;
+				if(isUnary(app.op)) return foldUnary(app.op, ((PrimType*)type)->type, a, out);
+
+				Literal b;
+				return eval(env, *app.args->next->item, b) && foldBinary(app.op, ((PrimType*)type)->type, a, b, out);
+			}
+			case Expr::App: {
+				auto& app = (AppExpr&)e;
+				if(!app.callee.hasImpl) return false;
+
+				auto count = app.callee.arguments.size();
+				auto args = (Literal*)alloca(sizeof(Literal) * count);
+				auto a = app.args;
+				for(Size i = 0; i < count; i++) {
+					if(!a || !eval(env, *a->item, args[i])) return false;
+					a = a->next;
+				}
+
+				return call((Function&)app.callee, args, out);
+			}
+			case Expr::Multi: {
+				for(auto x : ((MultiExpr&)e).es) {
+					if(!eval(env, *x, out)) return false;
+					if(returned) break;
+				}
+				return true;
+			}
+			case Expr::Scoped:
+				return eval(env, *((ScopedExpr&)e).contents, out);
+			case Expr::Assign: {
+				auto& assign = (AssignExpr&)e;
+				if(!eval(env, assign.value, out)) return false;
+				env.add(&assign.target, out);
+				return true;
+			}
+			case Expr::Store: {
+				// Only stores to local variables can be evaluated.
+				auto& store = (StoreExpr&)e;
+				if(!store.target.isVar()) return false;
+				if(!eval(env, store.value, out)) return false;
+				env.add(((VarExpr&)store.target).var, out);
+				return true;
+			}
+			case Expr::Ret:
+				if(!eval(env, ((RetExpr&)e).expr, out)) return false;
+				returned = true;
+				return true;
+			case Expr::If: {
+				auto& ife = (IfExpr&)e;
+				bool result = ife.mode == CondMode::And;
+				for(auto& c : ife.conds) {
+					Literal l;
+					if(c.scope && !eval(env, *c.scope, l)) return false;
+					if(!c.cond) continue;
+
+					if(!eval(env, *c.cond, l) || l.type != Literal::Bool) return false;
+					if(ife.mode == CondMode::And && !l.i) {result = false; break;}
+					if(ife.mode == CondMode::Or && l.i) {result = true; break;}
+				}
+
+				if(result) return eval(env, ife.then, out);
+				else if(ife.otherwise) return eval(env, *ife.otherwise, out);
+				else return true;
+			}
+			case Expr::While: {
+				auto& w = (WhileExpr&)e;
+				while(true) {
+					Literal c;
+					if(!eval(env, w.cond, c) || c.type != Literal::Bool) return false;
+					if(!c.i) return true;
+					if(!eval(env, w.loop, out)) return false;
+					if(returned) return true;
+				}
+			}
+			default:
+				// Anything else may have side effects or access memory.
+				return false;
+		}
+	}
+
+	U32 depth = 0;
+	U32 steps = 0;
+	bool returned = false;
+
+	// Set if evaluation failed because a function was still being resolved.
+	bool incomplete = false;
+};
+
+Expr* Resolver::foldPrimitiveOp(PrimitiveOp op, ExprRef lhs, ExprRef rhs, Type* type) {
+	if(!lhs.isLiteral() || !rhs.isLiteral() || !lhs.type->isPrimitive()) return nullptr;
+
+	Literal result;
+	if(foldBinary(op, ((PrimType*)lhs.type)->type, ((LitExpr&)lhs).literal, ((LitExpr&)rhs).literal, result)) {
+		return build<LitExpr>(result, type);
+	}
+	return nullptr;
+}
+
+Expr* Resolver::foldPrimitiveOp(PrimitiveOp op, ExprRef dst, Type* type) {
+	if(!dst.isLiteral() || !dst.type->isPrimitive()) return nullptr;
+
+	Literal result;
+	if(foldUnary(op, ((PrimType*)dst.type)->type, ((LitExpr&)dst).literal, result)) {
+		return build<LitExpr>(result, type);
+	}
+	return nullptr;
+}
+
+bool Resolver::evaluate(Function& fun, ExprList* args, Literal& result) {
+	Tritium::ScratchScope scratchScope{scratch};
+	Evaluator eval;
+	Evaluator::Env env;
+
+	auto count = fun.arguments.size();
+	auto values = (Literal*)alloca(sizeof(Literal) * count);
+	Hasher hasher;
+	hasher.add(&fun);
+	for(Size i = 0; i < count; i++) {
+		if(!args || !eval.eval(env, *args->item, values[i])) return false;
+		hasher.add(values[i].type);
+		hasher.add(values[i].i);
+		args = args->next;
+	}
+
+	// Calls with the same argument values always have the same result, so these are only evaluated once.
+	// Evaluated literals are never strings or characters, so each value is fully defined by its type and bits.
+	auto same = [&](const Literal* a) {
+		for(Size i = 0; i < count; i++) {
+			if(a[i].type != values[i].type || a[i].i != values[i].i) return false;
+		}
+		return true;
+	};
+
+	Evaluation** bucket;
+	if(evaluations.addGet(hasher.get(), bucket)) {
+		for(auto e = *bucket; e; e = e->next) {
+			if(e->fun == &fun && same(e->args)) {
+				result = e->result;
+				return e->success;
+			}
+		}
+	} else {
+		*bucket = nullptr;
+	}
+
+	auto success = eval.call(fun, values, result);
+
+	// Functions that are still being resolved may be evaluated successfully later.
+	if(eval.incomplete) return success;
+
+	auto e = build<Evaluation>();
+	e->fun = &fun;
+	e->args = (Literal*)buffer.alloc(sizeof(Literal) * count);
+	memcpy(e->args, values, sizeof(Literal) * count);
+	e->result = result;
+	e->success = success;
+	e->next = *bucket;
+	*bucket = e;
+	return success;
+}
+
+Expr* Resolver::createCall(FunctionDecl& fun, ExprList* args) {
+	// Calls to pure functions with constant arguments are replaced by their result.
+	if(fun.hasImpl && fun.type && fun.type->isPrimitive() && !isGeneric(&fun)) {
+		auto& f = (Function&)fun;
+		if(f.constant) return build<LitExpr>(f.constant->literal, f.type);
+
+		Literal result;
+		if(evaluate(f, args, result)) return build<LitExpr>(result, f.type);
+	}
+
+	return build<AppExpr>(fun, args);
+}
+
+void Resolver::findConstant(Function& fun) {
+	// Only functions without arguments and with a primitive result can be constants.
+	if(fun.generic || fun.arguments.size() || !fun.type->isPrimitive()) return;
+
+	Literal result;
+	if(evaluate(fun, nullptr, result)) {
+		fun.constant = build<LitExpr>(result, fun.type);
+	}
+}
+
+}} // namespace athena::resolve
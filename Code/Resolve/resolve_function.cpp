@@ -35,6 +35,22 @@ bool Resolver::resolveFunction(Scope& scope, Function& fun) {
 
     auto& decl = *fun.astDecl;
     assert(fun.name == decl.name);
+    if(attempt) *attempt << AttemptedFunction{&fun, &decl};
+
+    // Calls that could not be resolved are replaced with empty values, so the function is not complete in that case.
+    auto failedLookupsBefore = failedLookups;
+
+    // Temporary data used while resolving this function is released when it returns.
+    Tritium::ScratchScope scratchScope{scratch};
+
+    // Any generic types queued from here on belong to this function.
+    InferQueue queue(32);
+    auto outerQueue = inferQueue;
+    inferQueue = &queue;
+
+    // Functions that are resolved while resolving this one count their own generic calls.
+    auto outerGenericCalls = genericCalls;
+    genericCalls = 0;
 
     fun.scope.parent = &scope;
     fun.scope.function = &fun;
@@ -42,13 +58,20 @@ bool Resolver::resolveFunction(Scope& scope, Function& fun) {
         auto arg = decl.args->fields;
         while (arg) {
             auto a = resolveArgument(fun.scope, *arg->item);
+
+            // Instances of generic functions replace each generic argument with the type they were created for.
+            auto i = fun.arguments.size();
+            if(!a->type->resolved && i < fun.instanceArgs.size()) a->type = fun.instanceArgs[i];
+
             fun.arguments << a;
             arg = arg->next;
         }
     }
 
     if(decl.ret) {
-        fun.type = resolveType(scope, decl.ret);
+        // If an instance has a generic return type, it is inferred from the body instead.
+        auto type = resolveType(scope, decl.ret);
+        if(type->resolved || !fun.instanceOf) fun.type = type;
     }
 
     // Resolve locally defined functions.
@@ -80,6 +103,17 @@ bool Resolver::resolveFunction(Scope& scope, Function& fun) {
     if(fun.type) body = implicitCoerce(*body, fun.type);
     fun.expression = createRet(*body);
 
+    // Solve the constraints that were deferred while resolving the body,
+    // and replace each inferred argument type with its solution.
+    solveConstraints(queue);
+    inferQueue = outerQueue;
+    for(auto a : fun.arguments) {
+        a->type = substitute(a->type);
+    }
+
+    auto hasGenericCalls = genericCalls > 0;
+    genericCalls = outerGenericCalls;
+
 	// When the function parameters have been resolved, it is finished enough to be called.
 	// This must be done before resolving the expression to support recursive functions.
 	fun.astDecl = nullptr;
@@ -89,6 +123,10 @@ bool Resolver::resolveFunction(Scope& scope, Function& fun) {
     if(!fun.type) {
         fun.type = fun.expression->type;
     }
+    fun.type = substitute(fun.type);
+
+    // Check if this function always evaluates to a constant.
+    if(failedLookups == failedLookupsBefore) findConstant(fun);
 
     // Check if this is a generic function.
     for(auto a : fun.arguments) {
@@ -96,12 +134,57 @@ bool Resolver::resolveFunction(Scope& scope, Function& fun) {
     }
     if(!fun.type->resolved) fun.generic = true;
 
+    // Calls that were created before their argument types were inferred cannot be generated directly.
+    // The function is instantiated instead, which resolves these calls for the inferred types.
+    if(hasGenericCalls && !fun.instanceOf) fun.generic = true;
+
+    // Generic functions keep their source declaration, since each instance is resolved from it separately.
+    if(fun.generic) {
+        fun.genericDecl = &decl;
+        sourcePinned = true;
+    }
+
     return true;
 }
 
+Function* Resolver::instantiateFunction(Function& generic, ExprList* args) {
+    assert(generic.generic && generic.genericDecl);
+
+    // Find the concrete type of each argument.
+    // Arguments that were declared with a concrete type keep that type.
+    TypeList argTypes{(U32)generic.arguments.size()};
+    auto arg = args;
+    for(auto a : generic.arguments) {
+        if(a->type->resolved) {
+            argTypes << a->type;
+        } else {
+            auto t = arg->item->type;
+            if(t->isLvalue()) t = types.getRV(t);
+            if(!t->resolved) return nullptr;
+            argTypes << t;
+        }
+        arg = arg->next;
+    }
+
+    // Types are interned, so existing instances can be found by comparing type pointers.
+    for(auto i : generic.instances) {
+        U32 a = 0;
+        while(a < argTypes.size() && i->instanceArgs[a] == argTypes[a]) a++;
+        if(a == argTypes.size()) return i;
+    }
+
+    // The instance is registered before it is resolved to support recursive functions.
+    auto instance = build<Function>(generic.genericDecl->name, generic.genericDecl);
+    instance->instanceOf = &generic;
+    instance->instanceArgs = std::move(argTypes);
+    generic.instances << instance;
+    resolveFunction(*generic.scope.parent, *instance);
+    return instance;
+}
+
 Expr* Resolver::resolveFunctionCases(Scope& scope, Function& fun, ast::FunCaseList* cases) {
     if(cases) {
-        IfConds conds;
+        PatternConds conds;
         U32 i = 0;
         auto pat = cases->item->patterns;
         auto s = build<ScopedExpr>(scope);
@@ -118,7 +201,7 @@ Expr* Resolver::resolveFunctionCases(Scope& scope, Function& fun, ast::FunCaseLi
         }
 
         auto body = resolveExpression(s->scope, cases->item->body, true);
-        s->contents = createIf(std::move(conds), *body, resolveFunctionCases(scope, fun, cases->next), true, CondMode::And);
+        s->contents = createIf(conds, *body, resolveFunctionCases(scope, fun, cases->next), true, CondMode::And);
         s->type = body->type;
         return s;
     } else {
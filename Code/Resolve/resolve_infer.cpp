@@ -0,0 +1,222 @@
+#include "resolve.h"
+
+namespace athena {
+namespace resolve {
+
+/*
+ * Type inference is based on unification.
+ * Generic types that must be equal are merged into a set using union-find (with path compression and union by rank),
+ * so that checking if two generic types are the same takes nearly constant time.
+ * When a set is bound to a more specific type, any constraints on it are queued and solved once,
+ * at the end of the function that is being resolved.
+ * This keeps inference close to linear in the program size, since no constraint is ever checked twice.
+ */
+
+void Resolver::constrain(Type* type, const Constraint&& c) {
+	auto t = solvedType(type->canonical);
+	if(t->isGeneric()) {
+		auto g = (GenType*)t;
+		g->constraints << c;
+	} else {
+		// The type is known already, so the constraint can be checked directly.
+		auto constraint = c;
+		solveConstraint(t, constraint);
+	}
+}
+
+void Resolver::constrain(Type* type, Type* c) {
+	if(!unify(type, c)) {
+		error("type constraint cannot be satisfied");
+	}
+}
+
+bool Resolver::unify(Type* a, Type* b) {
+	// Lvalues and aliases are equivalent to the type they contain.
+	a = solvedType(a->canonical);
+	b = solvedType(b->canonical);
+	if(a == b) return true;
+
+	if(a->isGeneric()) return bind((GenType*)a, b);
+	if(b->isGeneric()) return bind((GenType*)b, a);
+
+	// Structural types are equal if their contents are.
+	if(a->kind == b->kind) {
+		if(a->isPointer()) {
+			return unify(((PtrType*)a)->type, ((PtrType*)b)->type);
+		} else if(a->kind == Type::Array) {
+			return unify(((ArrayType*)a)->type, ((ArrayType*)b)->type);
+		} else if(a->isTuple() && (!a->resolved || !b->resolved)) {
+			auto& af = ((TupleType*)a)->fields;
+			auto& bf = ((TupleType*)b)->fields;
+			if(af.size() != bf.size()) return false;
+
+			for(U32 i = 0; i < af.size(); i++) {
+				if(af[i].name != bf[i].name || !unify(af[i].type, bf[i].type)) return false;
+			}
+			return true;
+		}
+	}
+
+	// Concrete types can be unified if the first one can be used as the second one.
+	return typeCheck.compatible(a, b);
+}
+
+bool Resolver::bind(GenType* type, Type* to) {
+	assert(type->root() == type);
+
+	if(to->isGeneric()) {
+		// Merge the two sets, attaching the one with the lower rank to the other.
+		auto other = (GenType*)to;
+		assert(other->root() == other);
+
+		auto root = type;
+		auto child = other;
+		if(root->rank < child->rank) std::swap(root, child);
+		if(root->rank == child->rank) root->rank++;
+		child->parent = root;
+
+		// If both sets had a type constraint, these must be equal as well.
+		// The sets are linked already, so the child's constraints are moved to the root even if this fails.
+		bool unified = true;
+		if(child->typeConstraint) {
+			if(root->typeConstraint) {
+				unified = unify(root->typeConstraint, child->typeConstraint);
+			} else {
+				root->typeConstraint = child->typeConstraint;
+				root->solvedConstraints = child->solvedConstraints;
+				child->solvedConstraints = 0;
+				std::swap(root->constraints, child->constraints);
+			}
+		} else if(!root->typeConstraint && child->constraints.size() > root->constraints.size()) {
+			// Neither set has been solved yet; always append the smaller list to the larger one.
+			std::swap(root->constraints, child->constraints);
+		}
+
+		// Constraints that were solved in the child set were checked against a type equal to the root type,
+		// so only the unsolved ones need to be moved.
+		for(auto i = child->solvedConstraints; i < child->constraints.size(); i++) {
+			root->constraints << child->constraints[i];
+		}
+		child->constraints.erase();
+
+		if(inferQueue && root->typeConstraint && root->solvedConstraints < root->constraints.size()) {
+			*inferQueue << root;
+		}
+		return unified;
+	}
+
+	// A type cannot contain itself.
+	if(occurs(type, to)) {
+		error("cannot construct an infinite type");
+		return false;
+	}
+
+	if(type->typeConstraint) return unify(type->typeConstraint, to);
+
+	type->typeConstraint = to;
+	if(inferQueue && type->constraints.size()) *inferQueue << type;
+	return true;
+}
+
+bool Resolver::occurs(GenType* type, Type* in) {
+	in = solvedType(in->canonical);
+	if(in == type) return true;
+
+	switch(in->kind) {
+		case Type::Ptr:
+			return occurs(type, ((PtrType*)in)->type);
+		case Type::Array:
+			return occurs(type, ((ArrayType*)in)->type);
+		case Type::Tuple:
+			if(in->resolved) return false;
+			for(auto& f : ((TupleType*)in)->fields) {
+				if(occurs(type, f.type)) return true;
+			}
+			return false;
+		default:
+			return false;
+	}
+}
+
+bool Resolver::solveConstraint(Type* type, Constraint& c) {
+	if(auto constraint = FieldConstraint(c)) {
+		// Field constraints require the type to be a tuple with a matching field.
+		auto field = constraint->target;
+		auto t = type;
+		if(t->isPointer()) t = solvedType(((PtrType*)t)->type);
+		if(!t->isTuple()) {
+			error("type has no fields");
+			return false;
+		}
+
+		auto tuple = (TupleType*)t;
+		Field* f = nullptr;
+		if(field->name) {
+			f = tuple->findField(field->name);
+		} else if(field->index < tuple->fields.size()) {
+			f = &tuple->fields[field->index];
+		}
+
+		if(!f) {
+			error("type has no field named '%@'", context.find(field->name).name);
+			return false;
+		}
+
+		// The field access was created before the tuple was known, so it is pointed at the actual field now.
+		field->index = f->index;
+		field->container = tuple;
+		return unify(f->type, field->type);
+	}
+
+	// Function constraints require a function with that name to take the type as a parameter.
+	// Choosing the function to call requires each argument type, so this is done when the call is instantiated.
+	auto fun = FunConstraint(c);
+	if(!hasFunctionParameter(*fun->scope, fun->name, fun->index, type)) {
+		error("no function named '%@' takes this type as parameter %@", context.find(fun->name).name, fun->index);
+		failedLookups++;
+		return false;
+	}
+
+	return true;
+}
+
+void Resolver::solveConstraints(InferQueue& queue) {
+	// Solving a constraint can bind additional types, which are added to the end of the queue.
+	for(Size i = 0; i < queue.size(); i++) {
+		auto type = queue[i]->root();
+		if(!type->typeConstraint) continue;
+
+		while(type->solvedConstraints < type->constraints.size()) {
+			// Copy the constraint, since solving it may add to the list.
+			auto c = type->constraints[type->solvedConstraints++];
+			solveConstraint(solvedType(type->typeConstraint), c);
+		}
+	}
+}
+
+Type* Resolver::substitute(Type* type) {
+	switch(type->kind) {
+		case Type::Gen: {
+			auto t = solvedType(type);
+			return t->isGeneric() ? t : substitute(t);
+		}
+		case Type::Ptr:
+			return types.getPtr(substitute(((PtrType*)type)->type));
+		case Type::Array:
+			return types.getArray(substitute(((ArrayType*)type)->type));
+		case Type::Lvalue:
+			return types.getLV(substitute(type->canonical));
+		case Type::Tuple: {
+			if(type->resolved) return type;
+			auto fields = ((TupleType*)type)->fields;
+			for(auto& f : fields) {
+				f.type = substitute(f.type);
+			}
+			return types.getTuple(fields);
+		}
+		default:
+			return type;
+	}
+}
+
+}} // namespace athena::resolve
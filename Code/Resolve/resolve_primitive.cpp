@@ -126,6 +126,7 @@ Expr* Resolver::resolvePrimitiveOp(Scope& scope, PrimitiveOp op, ExprRef lhs, Ex
 		auto rt = ((const PrimType*)right->type)->type;
 
 		if(auto type = getBinaryOpType(op, lt, rt, left, right)) {
+			if(auto lit = foldPrimitiveOp(op, *left, *right, type)) return lit;
 			auto list = build<ExprList>(left, build<ExprList>(right));
 			return build<AppPExpr>(op, list, type);
 		}
@@ -147,6 +148,7 @@ Expr* Resolver::resolvePrimitiveOp(Scope& scope, PrimitiveOp op, resolve::ExprRe
 	} else {
 		auto type = ((const PrimType*)dst.type)->type;
 		if(auto rtype = getUnaryOpType(op, type)) {
+			if(auto lit = foldPrimitiveOp(op, dst, rtype)) return lit;
 			auto list = build<ExprList>(&dst);
 			return build<AppPExpr>(op, list, rtype);
 		}
@@ -0,0 +1,431 @@
+#include <algorithm>
+#include "resolve.h"
+
+namespace athena {
+namespace resolve {
+
+/*
+ * Streaming resolution resolves each top-level declaration as soon as the declarations it uses are available,
+ * instead of waiting until the whole module has been parsed.
+ * Since the language doesn't require declarations to be ordered, the names used by each declaration are collected
+ * from its AST first. A declaration that uses a name that is not declared yet is kept until that name appears.
+ * Declarations that use each other but are otherwise complete are resolved together,
+ * since resolving one of them will lazily resolve the others.
+ *
+ * Since functions can be overloaded, a call can also depend on overloads that are declared later.
+ * A declaration that calls a function that has no matching overload yet is kept until the module has been resolved.
+ * The calls made by each resolved declaration are recorded,
+ * so that overloads declared afterwards that would have been chosen instead can be reported once the module is complete.
+ */
+
+typedef Array<Id, Tritium::ScratchAllocator> IdList;
+
+/// Collects the names used by a declaration, as well as the names it defines locally.
+/// Locals are collected for the whole declaration, so a local that shadows a global name hides every use of that name.
+struct UseCollector {
+	IdList uses;
+	IdList locals;
+
+	void use(Id name) {uses << name;}
+	void bind(Id name) {locals << name;}
+
+	void decl(ast::Decl& decl) {
+		switch(decl.kind) {
+			case ast::Decl::Function:
+				fun((ast::FunDecl&)decl);
+				break;
+			case ast::Decl::Type:
+				type(((ast::TypeDecl&)decl).target);
+				break;
+			case ast::Decl::Data:
+				ast::walk(((ast::DataDecl&)decl).constrs, [&](ast::Constr* c) {
+					ast::walk(c->types, [&](ast::Type* t) {this->type(t);});
+				});
+				break;
+			case ast::Decl::Foreign:
+				type(((ast::ForeignDecl&)decl).type);
+				break;
+		}
+	}
+
+	void fun(ast::FunDecl& decl) {
+		if(decl.args) fields(decl.args->fields, true);
+		if(decl.ret) type(decl.ret);
+
+		ast::walk(decl.locals, [&](ast::FunDecl* f) {
+			this->bind(f->name);
+			this->fun(*f);
+		});
+
+		if(decl.body) {
+			expr(decl.body);
+		} else {
+			ast::walk(decl.cases, [&](ast::FunCase* c) {
+				ast::walk(c->patterns, [&](ast::Pattern* p) {this->pattern(p);});
+				this->expr(c->body);
+			});
+		}
+	}
+
+	void fields(ast::TupleFieldList* list, bool bindNames) {
+		ast::walk(list, [&](ast::TupleField* f) {
+			if(f->type) this->type(f->type);
+			if(f->defaultValue) this->expr(f->defaultValue);
+			if(bindNames && f->name) this->bind(f->name.force());
+		});
+	}
+
+	void type(ast::TypeRef type) {
+		switch(type->kind) {
+			case ast::Type::Con:
+			case ast::Type::Ptr:
+				use(type->con);
+				break;
+			case ast::Type::Tup:
+				fields(((ast::TupleType*)type)->fields, false);
+				break;
+			case ast::Type::Fun:
+				ast::walk(((ast::FunType*)type)->types, [&](ast::Type* t) {this->type(t);});
+				break;
+			case ast::Type::App:
+				this->type(((ast::AppType*)type)->base);
+				ast::walk(((ast::AppType*)type)->apps, [&](ast::Type* t) {this->type(t);});
+				break;
+			default:
+				// Unit and generic types don't refer to any declarations.
+				break;
+		}
+	}
+
+	void pattern(ast::Pattern* pat) {
+		if(pat->asVar) bind(pat->asVar);
+
+		switch(pat->kind) {
+			case ast::Pattern::Var:
+				bind(((ast::VarPattern*)pat)->var);
+				break;
+			case ast::Pattern::Tup:
+				ast::walk(((ast::TupPattern*)pat)->fields, [&](ast::FieldPat* f) {this->pattern(f->pat);});
+				break;
+			case ast::Pattern::Con:
+				use(((ast::ConPattern*)pat)->constructor);
+				ast::walk(((ast::ConPattern*)pat)->patterns, [&](ast::Pattern* p) {this->pattern(p);});
+				break;
+			default:
+				break;
+		}
+	}
+
+	void exprs(ast::ExprList* list) {
+		ast::walk(list, [&](ast::Expr* e) {this->expr(e);});
+	}
+
+	void expr(ast::ExprRef expr) {
+		if(!expr) return;
+
+		switch(expr->type) {
+			case ast::Expr::Multi:
+				exprs(((ast::MultiExpr*)expr)->exprs);
+				break;
+			case ast::Expr::Var:
+				use(((ast::VarExpr*)expr)->name);
+				break;
+			case ast::Expr::App:
+				this->expr(((ast::AppExpr*)expr)->callee);
+				exprs(((ast::AppExpr*)expr)->args);
+				break;
+			case ast::Expr::Lam: {
+				auto& lam = *(ast::LamExpr*)expr;
+				if(lam.args) fields(lam.args->fields, true);
+				this->expr(lam.body);
+				break;
+			}
+			case ast::Expr::Infix: {
+				auto& infix = *(ast::InfixExpr*)expr;
+				use(infix.op);
+				this->expr(infix.lhs);
+				this->expr(infix.rhs);
+				break;
+			}
+			case ast::Expr::Prefix:
+				use(((ast::PrefixExpr*)expr)->op);
+				this->expr(((ast::PrefixExpr*)expr)->dst);
+				break;
+			case ast::Expr::If: {
+				auto& ife = *(ast::IfExpr*)expr;
+				this->expr(ife.cond);
+				this->expr(ife.then);
+				this->expr(ife.otherwise);
+				break;
+			}
+			case ast::Expr::MultiIf:
+				ast::walk(((ast::MultiIfExpr*)expr)->cases, [&](ast::IfCase* c) {
+					this->expr(c->cond);
+					this->expr(c->then);
+				});
+				break;
+			case ast::Expr::Decl:
+				bind(((ast::DeclExpr*)expr)->name);
+				this->expr(((ast::DeclExpr*)expr)->content);
+				break;
+			case ast::Expr::While:
+				this->expr(((ast::WhileExpr*)expr)->cond);
+				this->expr(((ast::WhileExpr*)expr)->loop);
+				break;
+			case ast::Expr::Assign:
+				this->expr(((ast::AssignExpr*)expr)->target);
+				this->expr(((ast::AssignExpr*)expr)->value);
+				break;
+			case ast::Expr::Nested:
+				this->expr(((ast::NestedExpr*)expr)->expr);
+				break;
+			case ast::Expr::Coerce:
+				this->expr(((ast::CoerceExpr*)expr)->target);
+				type(((ast::CoerceExpr*)expr)->kind);
+				break;
+			case ast::Expr::Field: {
+				// Field names are looked up in the target type, so they don't refer to any declarations.
+				auto& field = *(ast::FieldExpr*)expr;
+				this->expr(field.target);
+				if(!field.field->isVar()) this->expr(field.field);
+				break;
+			}
+			case ast::Expr::Construct:
+				type(((ast::ConstructExpr*)expr)->type);
+				exprs(((ast::ConstructExpr*)expr)->args);
+				break;
+			case ast::Expr::TupleConstruct:
+				fields(((ast::TupleConstructExpr*)expr)->args, false);
+				break;
+			case ast::Expr::Format:
+				for(auto c = &((ast::FormatExpr*)expr)->format; c; c = c->next) {
+					this->expr(c->item.format);
+				}
+				break;
+			case ast::Expr::Case: {
+				auto& casee = *(ast::CaseExpr*)expr;
+				this->expr(casee.pivot);
+				ast::walk(casee.alts, [&](ast::Alt* alt) {
+					this->pattern(alt->pattern);
+					this->expr(alt->expr);
+				});
+				break;
+			}
+			default:
+				// Literals and unit values don't use any names.
+				break;
+		}
+	}
+};
+
+inline Id getDeclName(ast::Decl* decl) {
+	switch(decl->kind) {
+		case ast::Decl::Function: return ((ast::FunDecl*)decl)->name;
+		case ast::Decl::Type: return ((ast::TypeDecl*)decl)->type->name;
+		case ast::Decl::Data: return ((ast::DataDecl*)decl)->type->name;
+		case ast::Decl::Foreign: return ((ast::ForeignDecl*)decl)->importedName;
+	}
+
+	return 0;
+}
+
+inline bool isBuiltin(Resolver& resolver, Id name) {
+	if(resolver.types.primMap.get(name) || resolver.primitiveBinaryMap.get(name) || resolver.primitiveUnaryMap.get(name)) {
+		return true;
+	}
+
+	// The Bool constructors are handled by the resolver directly.
+	auto& string = resolver.context.find(name).name;
+	return string == "True" || string == "False";
+}
+
+bool Resolver::isDeclared(Module& module, Id name) {
+	return module.functions.get(name) || module.types.get(name) || module.constructors.get(name) || isBuiltin(*this, name);
+}
+
+void Resolver::resolveStreaming(Module& module, ast::Decl* decl, Array<FunctionDecl*>& resolved) {
+	Tritium::ScratchScope scratchScope{scratch};
+
+	PendingDecl pending;
+	pending.decl = decl;
+	pending.fun = declare(module, decl);
+	pending.name = getDeclName(decl);
+
+	// Uses of the constructors of a data type are blocked by the type as well.
+	if(decl->kind == ast::Decl::Data) {
+		ast::walk(((ast::DataDecl*)decl)->constrs, [&](ast::Constr* c) {pending.constructors << c->name;});
+	}
+
+	// Find the names that have to be declared outside of this declaration.
+	// Each name is only stored once, and built-in names never have to wait for anything.
+	UseCollector collector;
+	collector.decl(*decl);
+
+	auto& locals = collector.locals;
+	auto& uses = collector.uses;
+	auto localNames = locals.pointer();
+	auto localCount = locals.size();
+	std::sort(localNames, localNames + localCount);
+	std::sort(uses.pointer(), uses.pointer() + uses.size());
+
+	for(U32 i = 0; i < uses.size(); i++) {
+		auto name = uses[i];
+		if(i > 0 && uses[i - 1] == name) continue;
+		if(std::binary_search(localNames, localNames + localCount, name)) continue;
+		if(isBuiltin(*this, name)) continue;
+		pending.uses << name;
+	}
+
+	pendingDecls << std::move(pending);
+
+	// A declaration is blocked if it uses a name that is not declared yet,
+	// or a name that is declared by a blocked declaration, including the constructors of a blocked data type.
+	// The declarations that use each name are indexed, so that blocking can be propagated from each blocked declaration to its users.
+	struct Use {
+		Id name;
+		U32 decl;
+		bool operator < (const Use& u) const {return name < u.name;}
+	};
+
+	Array<Use, Tritium::ScratchAllocator> useIndex;
+	Array<U32, Tritium::ScratchAllocator> blocked;
+	for(U32 i = 0; i < pendingDecls.size(); i++) {
+		auto& p = pendingDecls[i];
+		p.blocked = p.deferred;
+		if(p.deferred) blocked << i;
+
+		for(auto name : p.uses) {
+			useIndex << Use{name, i};
+			if(!p.blocked && !isDeclared(module, name)) {
+				p.blocked = true;
+				blocked << i;
+			}
+		}
+	}
+
+	std::sort(useIndex.pointer(), useIndex.pointer() + useIndex.size());
+
+	auto blockUsers = [&](Id name) {
+		auto range = std::equal_range(useIndex.pointer(), useIndex.pointer() + useIndex.size(), Use{name, 0});
+		for(auto u = range.first; u != range.second; u++) {
+			auto& p = pendingDecls[u->decl];
+			if(!p.blocked) {
+				p.blocked = true;
+				blocked << u->decl;
+			}
+		}
+	};
+
+	// Each declaration is only added to the list once, so its users are only visited once.
+	for(U32 i = 0; i < blocked.size(); i++) {
+		auto& p = pendingDecls[blocked[i]];
+		blockUsers(p.name);
+		for(auto name : p.constructors) blockUsers(name);
+	}
+
+	// A function can call an overload that is not declared yet, which is only known once it has been resolved.
+	// If any lookup fails, each function that was resolved as part of it is reset to its source declaration.
+	auto resolveAttempt = [&](FunctionDecl& fun) {
+		Array<AttemptedFunction> functions;
+		auto failed = failedLookups;
+		auto lookups = streamedLookups.size();
+		auto pinned = sourcePinned;
+
+		attempt = &functions;
+		resolveFunctionDecl(module, fun);
+		attempt = nullptr;
+		if(failedLookups == failed) return true;
+
+		// Instances are removed from their generic function, which may have been resolved earlier.
+		// Other functions are reset in place, since they can be referenced from the module or from pending declarations.
+		for(U32 i = functions.size(); i > 0; i--) {
+			auto f = functions[i - 1];
+			if(auto generic = f.fun->instanceOf) {
+				auto& instances = generic->instances;
+				for(U32 j = 0; j < instances.size(); j++) {
+					if(instances[j] == f.fun) {
+						instances.remove(j);
+						break;
+					}
+				}
+			} else {
+				auto sibling = f.fun->sibling;
+				f.fun->~Function();
+				new(f.fun) Function(f.decl->name, f.decl);
+				f.fun->sibling = sibling;
+			}
+		}
+
+		// Evaluations of the reset functions are no longer valid. The cache is rebuilt when they are called again.
+		evaluations.clear();
+		streamedLookups.resize(lookups);
+		sourcePinned = pinned;
+		return false;
+	};
+
+	// Resolve the declarations that are ready in the order they were declared, and keep the others.
+	// The names used by each resolved declaration are released together with the old list.
+	Array<PendingDecl> remaining;
+	for(auto& p : pendingDecls) {
+		if(p.blocked) {
+			remaining << std::move(p);
+		} else if(p.fun) {
+			if(resolveAttempt(*p.fun)) {
+				resolved << p.fun;
+			} else {
+				p.deferred = true;
+				remaining << std::move(p);
+			}
+		} else if(auto t = module.types.get(p.name)) {
+			lazyResolve(*t.force());
+		}
+	}
+
+	pendingDecls = std::move(remaining);
+}
+
+void Resolver::recordLookup(ScopeRef scope, Id name, ExprList* args, FunctionDecl* callee) {
+	auto module = &scope;
+	while(module->parent) module = module->parent;
+
+	FunctionDecl* overloads = nullptr;
+	if(auto f = module->functions.get(name)) overloads = *f.force();
+
+	// Argument types that are still being inferred are bound to the parameters of the callee later,
+	// so they are replaced by a type that can be passed to any parameter.
+	auto copy = map(args, [&](Expr* e) -> Expr* {
+		if(!e->type->resolved) return this->build<EmptyExpr>(this->build<GenType>(0));
+		if(auto l = findLiteral(*e)) return this->build<LitExpr>(l->literal, l->type);
+		return e;
+	});
+
+	streamedLookups << StreamedLookup{name, overloads, copy, callee};
+}
+
+Id Resolver::findLateOverload(Module& module) {
+	Tritium::ScratchScope scratchScope{scratch};
+	for(auto& lookup : streamedLookups) {
+		auto f = module.functions.get(lookup.name);
+		if(!f) continue;
+
+		// Overloads are added to the front of the list, so each one before the recorded one was declared after the lookup.
+		CalleeList callees{8};
+		for(auto fn = *f.force(); fn != lookup.overloads; fn = fn->sibling) {
+			resolveFunctionDecl(module, *fn);
+			if(potentiallyCallable(fn, lookup.args)) callees << fn;
+		}
+
+		if(!callees.size()) continue;
+
+		// Calls created before their argument types were known would have had more than one option.
+		// Otherwise, the callee must still be the best match. Later overloads that match just as well are ambiguous.
+		if(!lookup.callee) return lookup.name;
+
+		callees << lookup.callee;
+		if(findBestMatch(callees, lookup.args) != lookup.callee) return lookup.name;
+	}
+
+	return 0;
+}
+
+}} // namespace athena::resolve
@@ -75,33 +75,15 @@ Type* Resolver::resolveVariant(VarType* type) {
 }
 
 Type* Resolver::resolveTuple(Scope& scope, ast::TupleType& type, ast::SimpleType* tscope) {
-	// Generate a hash for the fields.
-	Hasher h;
-	ast::walk(type.fields, [&](auto i) {
-		auto t = this->resolveType(scope, i->type, false, tscope);
-		h.add(t);
-		// Include the name to ensure that different tuples with the same memory layout are not exactly the same.
-		if(i->name) h.add(i->name.force());
+	FieldList fields;
+	U32 i = 0;
+	ast::walk(type.fields, [&](auto it) {
+		auto t = this->resolveType(scope, it->type, false, tscope);
+		fields << Field{it->name ? it->name.force() : 0, i, t, nullptr, nullptr, true};
+		i++;
 	});
 
-	// Check if this kind of tuple has been used already.
-	TupleType* result = nullptr;
-	if(!types.getTuple((uint32_t)h, result)) {
-		// Otherwise, create the type.
-		new (result) TupleType;
-		U32 i = 0;
-		bool resolved = true;
-		ast::walk(type.fields, [&](auto it) {
-			auto t = this->resolveType(scope, it->type, false, tscope);
-			if(!t->resolved) resolved = false;
-			result->fields << Field{it->name ? it->name.force() : 0, i, t, result, nullptr, true};
-			i++;
-		});
-
-		result->resolved = resolved;
-	}
-
-	return result;
+	return types.getTuple(fields);
 }
 
 inline Maybe<uint32_t> getGenIndex(ast::SimpleType& type, Id name) {
@@ -142,6 +124,8 @@ Type* Resolver::resolveType(ScopeRef scope, ast::TypeRef type, bool constructor,
 		auto atype = (ast::AppType*)type;
 		auto base = resolveType(scope, atype->base, constructor, tscope);
 		if(base->isGeneric()) {
+			// The type arguments are resolved from the source when the containing type is instantiated.
+			sourcePinned = true;
 			return build<AppType>(((GenType*)base)->index, atype->apps);
 		} else {
 			return instantiateType(scope, base, atype->apps, tscope);
@@ -150,7 +134,7 @@ Type* Resolver::resolveType(ScopeRef scope, ast::TypeRef type, bool constructor,
 		// Check if this type has been defined in this scope.
 		if(constructor) {
 			if (auto t = scope.findConstructor(type->con))
-				return t->parentType;
+				return lazyResolve(t->parentType);
 
 			// TODO: This is kind of a hack.
 			// The Bool primitive type has separate constructors.
@@ -204,36 +188,15 @@ Type* Resolver::instantiateType(ScopeRef scope, Type* base, ast::TypeList* apps,
 }
 
 Type* Resolver::lazyResolve(Type* t) {
-	if(t->kind == Type::Alias && ((AliasType*)t)->astDecl) {
-		resolveAlias((AliasType*)t);
+	if(t->kind == Type::Alias) {
+		// Aliases are equivalent to their contents, even if they were resolved through a different path.
+		auto a = (AliasType*)t;
+		if(a->astDecl) return resolveAlias(a);
+		return a->resolved ? a->canonical : a;
 	} else if(t->kind == Type::Var && ((VarType*)t)->astDecl) {
 		resolveVariant((VarType*)t);
 	}
 	return t;
 }
 
-void Resolver::constrain(Type* type, const Constraint&& c) {
-	if(type->canonical->isGeneric()) {
-		// TODO: Check if constraints conflict.
-		((GenType*)type->canonical)->constraints << c;
-	} else {
-		assert(false);
-	}
-}
-
-void Resolver::constrain(Type* type, Type* c) {
-	if(type->canonical->isGeneric()) {
-		auto t = (GenType*)type->canonical;
-		if(t->typeConstraint) {
-			// TODO: Merge constrained types.
-			assert("Not implemented" == 0);
-		} else {
-			t->typeConstraint = c;
-		}
-	} else {
-		// TODO: Merge complete types.
-		assert("Not implemented" == 0);
-	}
-}
-
 }} // namespace athena::resolve
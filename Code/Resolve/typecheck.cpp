@@ -10,52 +10,123 @@ inline void error(Maybe<Diagnostics*> diag, const char* text) {
 	}
 }
 
-bool TypeCheck::implicitCoerce(Type* src, Type* dst, Maybe<Diagnostics*> diag) {
-	// Lvalue types are semantically equivalent and can always be implicitly converted.
-	if(src != src->canonical) {
-		return compatible(src->canonical, dst);
+/*
+ * Implicit conversion rules:
+ *  - floating point types can be converted to a larger type.
+ *  - integer types can be converted to a larger type of the same signedness.
+ *  - pointer types can be converted to Bool.
+ *  - tuples can be converted to more defined tuples.
+ * Special case: Integer and Float literals can be converted to any integer or float type.
+ *
+ * The costs are used to rank overloads: widening is cheaper the closer the types are in size,
+ * and conversions that change the kind of value are the most expensive.
+ */
+
+static const U32 kPrimitiveCount = (U32)PrimitiveType::TypeCount;
+
+struct PrimitiveCoercions {
+	PrimitiveCoercions() {
+		for(U32 s = 0; s < kPrimitiveCount; s++) {
+			for(U32 d = 0; d < kPrimitiveCount; d++) {
+				auto src = (PrimitiveType)s;
+				auto dst = (PrimitiveType)d;
+				auto& c = table[s][d];
+				if(s == d) {
+					c = {CoercionKind::Identity, 0};
+				} else if(category(src) == category(dst) && category(src) != PrimitiveTypeCategory::Other && dst < src) {
+					// Types within a category are ordered large to small.
+					c = {CoercionKind::Widen, (U8)(s - d)};
+				} else {
+					c = {CoercionKind::None, 0};
+				}
+			}
+
+			// Integer literals convert to integers for free, and float literals to floats.
+			auto src = (PrimitiveType)s;
+			auto& i = literals[0][s];
+			auto& f = literals[1][s];
+			if(src < PrimitiveType::FirstFloat) {
+				i = {CoercionKind::Literal, 0};
+				f = {CoercionKind::Literal, 2};
+			} else if(src < PrimitiveType::FirstOther) {
+				i = {CoercionKind::Literal, 1};
+				f = {CoercionKind::Literal, 0};
+			} else {
+				i = f = {CoercionKind::None, 0};
+			}
+		}
 	}
 
-	// Only primitive types can be implicitly converted:
-	//  - floating point types can be converted to a larger type.
-	//  - integer types can be converted to a larger type.
-	//  - pointer types can be converted to Bool.
-	//  - Bool can be converted to an integer type.
-	// Special case: literals can be converted into any type of the same category.
+	Coercion table[kPrimitiveCount][kPrimitiveCount];
+	Coercion literals[2][kPrimitiveCount]; // Int and Float literals.
+};
+
+static const PrimitiveCoercions primitiveCoercions;
+
+Coercion TypeCheck::findCoercion(Type* src, Type* dst) {
+	if(src == dst) return {CoercionKind::Identity, 0};
+
+	// Lvalue types are semantically equivalent and can always be implicitly converted.
+	if(src != src->canonical) return findCoercion(src->canonical, dst);
+
 	if(src->isPrimitive() && dst->isPrimitive()) {
-		auto s = ((PrimType*)src)->type;
-		auto d = ((PrimType*)dst)->type;
-		if(category(s) == category(d) && d <= s) {
-			return true;
-		} else {
-			error(diag, "a primitive type can only be implicitly converted to a larger type");
-		}
+		return primitiveCoercions.table[(U32)((PrimType*)src)->type][(U32)((PrimType*)dst)->type];
 	} else if(src->isPointer()) {
-		if(dst->isBool()) {
-			return true;
-		} else {
-			error(diag, "pointer types can only be implicitly converted to Bool");
-		}
-	} else if(src->isBool() && dst->isPrimitive()) {
-		if(((PrimType*)dst)->type < PrimitiveType::FirstFloat) {
-			return true;
-		} else {
-			error(diag, "booleans can only be implicitly converted to an integer types");
-		}
+		if(dst->isBool()) return {CoercionKind::PtrToBool, 4};
 	} else if(src->isTuple() && dst->isTuple()) {
-		// Tuples can be implicitly converted to more defined tuples.
-		auto s = (TupleType*)src;
-		auto d = (TupleType*)dst;
-		if(s->fields.size() != d->fields.size()) return false;
-
-		for(U32 i=0; i<s->fields.size(); i++) {
-			if(s->fields[i].name && s->fields[i].name != d->fields[i].name) return false;
-			if(!compatible(s->fields[i].type, d->fields[i].type)) return false;
+		// Tuples that are not fully resolved can still change, so only resolved ones are cached.
+		if(!src->resolved || !dst->resolved) return findTupleCoercion((TupleType*)src, (TupleType*)dst);
+
+		Coercion* c;
+		if(!coercions.addGet(TypePair{src, dst}, c)) {
+			*c = findTupleCoercion((TupleType*)src, (TupleType*)dst);
 		}
+		return *c;
+	}
 
-		return true;
-	} else {
-		error(diag, "only primitive types or pointers can be implicitly converted");
+	return {CoercionKind::None, 0};
+}
+
+Coercion TypeCheck::findTupleCoercion(TupleType* src, TupleType* dst) {
+	if(src->fields.size() != dst->fields.size()) return {CoercionKind::None, 0};
+
+	// The cost is the sum of the field conversions.
+	U32 cost = 0;
+	for(U32 i = 0; i < src->fields.size(); i++) {
+		auto& s = src->fields[i];
+		auto& d = dst->fields[i];
+		if(s.name && s.name != d.name) return {CoercionKind::None, 0};
+
+		auto c = findCoercion(s.type, d.type);
+		if(!c) return c;
+		cost += c.cost;
+	}
+
+	return {CoercionKind::Tuple, (U8)(cost < 255 ? cost : 255)};
+}
+
+Coercion TypeCheck::findLiteralCoercion(Literal::Type lit, Type* dst) {
+	dst = dst->canonical;
+	if(dst->isPrimitive()) {
+		auto d = (U32)((PrimType*)dst)->type;
+		if(lit == Literal::Int) return primitiveCoercions.literals[0][d];
+		if(lit == Literal::Float) return primitiveCoercions.literals[1][d];
+	}
+	return {CoercionKind::None, 0};
+}
+
+bool TypeCheck::implicitCoerce(Type* src, Type* dst, Maybe<Diagnostics*> diag) {
+	if(findCoercion(src, dst)) return true;
+
+	if(diag) {
+		src = src->canonical;
+		if(src->isPrimitive() && dst->isPrimitive()) {
+			error(diag, "a primitive type can only be implicitly converted to a larger type");
+		} else if(src->isPointer()) {
+			error(diag, "pointer types can only be implicitly converted to Bool");
+		} else if(!src->isTuple()) {
+			error(diag, "only primitive types or pointers can be implicitly converted");
+		}
 	}
 
 	return false;
@@ -95,23 +166,14 @@ bool TypeCheck::literalCoerce(const ast::Literal& lit, Type* dst, Literal& liter
 }
 
 bool TypeCheck::literalCoerce(const Literal& lit, Type* dst, Maybe<Diagnostics*> diag) {
-	// Literal conversion rules:
-	//  - Integer and Float literals can be converted to any other integer or float
-	//    (warnings should be issued if the value would not fit).
+	if(findLiteralCoercion(lit.type, dst)) return true;
+
 	if(dst->isPrimitive()) {
-		auto ptype = ((const PrimType*)dst)->type;
-		if(lit.type == ast::Literal::Int && ptype < PrimitiveType::FirstOther) {
-			return true;
-		} else if(lit.type == ast::Literal::Float && ptype < PrimitiveType::FirstOther) {
-			return true;
-		} else {
-			error(diag, "cannot convert this literal to the target type");
-			return false;
-		}
+		error(diag, "cannot convert this literal to the target type");
 	} else {
 		error(diag, "literals can only be converted to primitive types");
-		return false;
 	}
+	return false;
 }
 
 }} // namespace athena::resolve
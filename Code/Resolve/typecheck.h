@@ -3,10 +3,30 @@
 
 #include "resolve_ast.h"
 #include "../General/compiler.h"
+#include "../General/map.h"
 
 namespace athena {
 namespace resolve {
 
+/// The ways in which a value can be implicitly converted to a different type.
+enum class CoercionKind : U8 {
+	None,      // No implicit conversion exists.
+	Identity,  // The types are equivalent.
+	Widen,     // A primitive type is converted to a larger type in the same category.
+	PtrToBool, // A pointer is converted to Bool.
+	Tuple,     // Each field of a tuple is converted separately.
+	Literal    // A literal is converted to a primitive type.
+};
+
+/// Describes an implicit conversion and its cost.
+/// Overloads that need cheaper conversions are preferred.
+struct Coercion {
+	CoercionKind kind;
+	U8 cost;
+
+	explicit operator bool() const {return kind != CoercionKind::None;}
+};
+
 struct TypeCheck {
 	bool compatible(ExprRef src, ExprRef dst) {
 		return compatible(src.type, dst.type);
@@ -24,9 +44,18 @@ struct TypeCheck {
 	}
 
 	bool compatible(Type* src, Type* dst) {
-		return src == dst || implicitCoerce(src, dst, Nothing());
+		// Structural types are interned by the TypeManager, so equal types always have the same pointer.
+		return src == dst || (bool)findCoercion(src, dst);
 	}
 
+	/// Returns how the source type can be implicitly converted to the target type.
+	/// Conversions between primitive types are looked up in a precomputed table,
+	/// while the results for resolved tuple types are cached.
+	Coercion findCoercion(Type* src, Type* dst);
+
+	/// Returns how a literal of the provided kind can be implicitly converted to the target type.
+	static Coercion findLiteralCoercion(Literal::Type lit, Type* dst);
+
 	/// Returns true if the source type can be implicitly converted to the target type.
 	/// @param diag The diagnostics engine to use if an error should be produced.
 	bool implicitCoerce(Type* source, Type* target, Maybe<Diagnostics*> diag);
@@ -36,6 +65,20 @@ struct TypeCheck {
 	/// @return True if the literal can be converted.
 	bool literalCoerce(const ast::Literal& lit, Type* dst, Literal& target, Maybe<Diagnostics*> diag);
 	bool literalCoerce(const Literal& lit, Type* dst, Maybe<Diagnostics*> diag);
+
+private:
+	struct TypePair {
+		Type* src;
+		Type* dst;
+
+		bool operator == (const TypePair& p) const {return src == p.src && dst == p.dst;}
+		bool operator < (const TypePair& p) const {return src < p.src || (src == p.src && dst < p.dst);}
+	};
+
+	Coercion findTupleCoercion(TupleType* src, TupleType* dst);
+
+	// Conversions between resolved structural types that were checked before.
+	Tritium::Map<TypePair, Coercion> coercions{64};
 };
 
 }} // namespace athena::resolve
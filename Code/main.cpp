@@ -14,9 +14,15 @@
 #include <llvm/IR/Verifier.h>
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include "Parse/parser.h"
 #include "Resolve/resolve.h"
 #include "Generate/generate.h"
+#include "Generate/optimize.h"
+#include "Generate/emit.h"
+#include "Generate/jit.h"
+#include "Generate/cache.h"
+#include "Generate/incremental.h"
 
 void CreateAddFunc(llvm::LLVMContext& context, llvm::Module* module)
 {
@@ -35,9 +41,90 @@ void CreateAddFunc(llvm::LLVMContext& context, llvm::Module* module)
 	//builder.CreateAdd(addFunc->)
 }
 
-int main()
+int main(int argc, const char** argv)
 {
-	athena::ast::CompileContext context{athena::CompileSettings{}};
+	// Usage: athena [-entry=<function>]... [-stream] [-O0|-O1|-O2|-O3] [-time-passes] [-c|-S] [-o <output>] [-threads=<count>]
+	//               [-cache=<directory>] [-cache-size=<megabytes>] [-cache-stats] [-incremental]
+	//               [-target=<triple>] [-mcpu=<cpu>|-march=<cpu>] [-mattr=<+feature,-feature,...>] [file]
+	//        athena run [-lazy] [-tiered] [-tier-threshold=<count>] [options] [file]
+	// By default, textual IR is written. With -c an object file is written instead, and with -S native assembly.
+	// Native code can be generated on multiple threads, which writes a file for each thread (out.0.o, out.1.o, ...).
+	// Incremental builds write an archive of function objects instead (out.a), and need a cache directory.
+	// Code is generated for a generic CPU of the host architecture, unless a CPU is selected. The CPU "native" selects the host CPU.
+	// Without a file, one of the built-in test programs is compiled.
+	athena::CompileSettings settings;
+	const char* inputFile = nullptr;
+
+	// In run mode, the program is compiled in memory and its main function is called directly.
+	bool run = argc > 1 && std::string(argv[1]) == "run";
+	for(int i = run ? 2 : 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if(arg.compare(0, 7, "-entry=") == 0) {
+			settings.entryPoints.push_back(arg.substr(7));
+		} else if(arg == "-stream") {
+			settings.streaming = true;
+		} else if(arg.size() == 3 && arg[0] == '-' && arg[1] == 'O' && arg[2] >= '0' && arg[2] <= '3') {
+			settings.optLevel = (U32)(arg[2] - '0');
+		} else if(arg == "-time-passes") {
+			settings.timePasses = true;
+		} else if(arg == "-c") {
+			settings.output = athena::OutputKind::Object;
+		} else if(arg == "-S") {
+			settings.output = athena::OutputKind::Assembly;
+		} else if(arg == "-lazy") {
+			settings.lazyJit = true;
+		} else if(arg == "-tiered") {
+			settings.lazyJit = true;
+			settings.tieredJit = true;
+		} else if(arg.compare(0, 16, "-tier-threshold=") == 0) {
+			settings.tierThreshold = (U32)strtoul(arg.c_str() + 16, nullptr, 10);
+		} else if(arg.compare(0, 9, "-threads=") == 0) {
+			settings.codegenThreads = std::max((U32)strtoul(arg.c_str() + 9, nullptr, 10), 1u);
+		} else if(arg.compare(0, 7, "-cache=") == 0) {
+			settings.cacheDirectory = arg.substr(7);
+		} else if(arg.compare(0, 12, "-cache-size=") == 0) {
+			settings.cacheSize = (U64)strtoull(arg.c_str() + 12, nullptr, 10) * 1024 * 1024;
+		} else if(arg == "-cache-stats") {
+			settings.cacheStats = true;
+		} else if(arg == "-incremental") {
+			settings.incremental = true;
+		} else if(arg.compare(0, 8, "-target=") == 0) {
+			settings.targetTriple = arg.substr(8);
+		} else if(arg.compare(0, 6, "-mcpu=") == 0 || arg.compare(0, 7, "-march=") == 0) {
+			settings.targetCpu = arg.substr(arg.find('=') + 1);
+		} else if(arg.compare(0, 7, "-mattr=") == 0) {
+			settings.targetFeatures = arg.substr(7);
+		} else if(arg == "-o" && i + 1 < argc) {
+			settings.outputFile = argv[++i];
+		} else if(arg[0] == '-') {
+			std::cerr << "unknown option '" << arg << "'" << std::endl;
+			return 1;
+		} else {
+			inputFile = argv[i];
+		}
+	}
+
+	// Incremental builds keep the object of each function in the cache, and compile each function separately instead of partitioning.
+	if(settings.incremental) {
+		if(settings.cacheDirectory.empty()) {
+			std::cerr << "incremental builds require a cache directory" << std::endl;
+			return 1;
+		}
+		settings.codegenThreads = 1;
+	}
+
+	// Programs that are run directly use the code generated for them, so they have to target the host.
+	if(run && athena::gen::getTargetTriple(settings) != athena::gen::getTargetTriple(athena::CompileSettings{})) {
+		std::cerr << "programs for a different target cannot be run" << std::endl;
+		return 1;
+	}
+
+	// Only the code that main uses has to be compiled before running it.
+	if(run && settings.entryPoints.empty()) {
+		settings.entryPoints.push_back("main");
+	}
+
+	athena::ast::CompileContext context{settings};
 
 	auto test = R"s(
 main =
@@ -149,35 +236,216 @@ parseInt [string *U8] =
 id x = x
 )s";
 
+	std::string source = gentest;
+	if(inputFile) {
+		std::ifstream file{inputFile};
+		if(!file) {
+			std::cerr << "cannot open '" << inputFile << "'" << std::endl;
+			return 1;
+		}
+		source.assign(std::istreambuf_iterator<char>{file}, std::istreambuf_iterator<char>{});
+	}
+
 	athena::ast::Module module;
     athena::StdOutDiagnosticConsumer diagPrinter;
 	athena::Diagnostics diagnostics{diagPrinter};
-	athena::ast::Parser p(context, diagnostics, module, gentest);
-	p.parseModule();
+	athena::ast::Parser p(context, diagnostics, module, source.c_str());
+	athena::resolve::Resolver resolver{context, module};
 
+	llvm::LLVMContext llcontext;
+	std::unique_ptr<llvm::Module> llmodule{new llvm::Module("top", llcontext)};
+
+	// The generator lays out types according to the module, so it always uses the layout of the target.
+	// This is also needed for textual IR, which would otherwise have a different layout than the native code for it.
+	std::unique_ptr<llvm::TargetMachine> target;
 	{
-        std::ofstream file{"ast.txt"};
-        if(file) {
-            auto string = athena::ast::toString(module, context);
-            file << string;
-        }
+		std::string error;
+		athena::gen::initTargets();
+		target.reset(athena::gen::createTargetMachine(settings, error));
+		if(!target) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+		llmodule->setTargetTriple(target->getTargetTriple().str());
+		llmodule->setDataLayout(target->createDataLayout());
 	}
 
-	athena::resolve::Resolver resolver{context, module};
-	auto resolved = resolver.resolve();
-
-	llvm::LLVMContext llcontext;
-	llvm::Module* llmodule = new llvm::Module("top", llcontext);
-	llmodule->setDataLayout("e-S128");
-	llmodule->setTargetTriple(LLVM_HOST_TRIPLE);
+	// Modules that did not change since they were cached skip everything up to code generation.
+	// The lazy JIT only generates the code that runs, so it doesn't use the cache.
+	std::unique_ptr<athena::gen::ModuleCache> cache;
+	std::string cacheKey;
+	bool cached = false;
+	if(!settings.cacheDirectory.empty() && !(run && settings.lazyJit)) {
+		cache.reset(new athena::gen::ModuleCache(settings.cacheDirectory, settings.cacheSize));
+		cacheKey = cache->getKey(source, settings, *llmodule, run);
+		if(auto m = cache->load(cacheKey, llcontext)) {
+			llmodule = std::move(m);
+			cached = true;
+		}
+	}
 
 	athena::gen::Generator gen{context, llcontext, *llmodule};
-	gen.generate(*resolved);
+	athena::resolve::Module* resolved = nullptr;
+
+	// Streaming is only useful if every declaration is compiled;
+	// with entry points, declarations cannot be resolved until all of them are known.
+	// Cached modules were generated and optimized already.
+	if(cached) {
+	} else if(settings.streaming && settings.entryPoints.empty()) {
+		// The parsed declarations are released once they use this much memory and nothing refers to them.
+		const Size releaseThreshold = 256 * 1024;
+
+		resolved = resolver.createModule();
+		Array<athena::resolve::FunctionDecl*> functions;
+		U32 next = 0;
+		p.parseModule([&] {
+			for(; next < module.declarations.size(); next++) {
+				resolver.resolveStreaming(*resolved, module.declarations[next], functions);
+			}
+
+			for(auto f : functions) {
+				if(!f->codegen && !athena::resolve::isGeneric(f)) gen.genFunctionDecl(*f);
+			}
+			functions.clear();
+
+			if(resolver.canReleaseSource() && p.getUsedMemory() >= releaseThreshold) {
+				p.releaseDecls();
+				next = 0;
+			}
+		});
+
+		// Resolve any declarations that were still waiting for names that were never declared.
+		// These produce the same errors as in a normal compilation.
+		resolver.resolveModule(*resolved);
+
+		// Functions that were generated while parsing cannot use overloads that were declared after them.
+		if(auto name = resolver.findLateOverload(*resolved)) {
+			std::cerr << "an overload of '" << context.find(name).name << "' is declared after a function that calls it was compiled" << std::endl;
+			return 1;
+		}
+
+		gen.generate(*resolved);
+	} else {
+		p.parseModule();
+
+		{
+			std::ofstream file{"ast.txt"};
+			if(file) {
+				auto string = athena::ast::toString(module, context);
+				file << string;
+			}
+		}
+
+		resolved = resolver.resolve();
+
+		// Entry points that don't exist would otherwise produce an empty program.
+		for(auto& entry : settings.entryPoints) {
+			if(!resolved->functions.get(context.addUnqualifiedName(entry))) {
+				if(run && entry == "main") {
+					std::cerr << "the program has no main function" << std::endl;
+				} else {
+					std::cerr << "the entry point '" << entry << "' is not defined" << std::endl;
+				}
+				return 1;
+			}
+		}
+
+		// The lazy JIT generates each function when it is first called.
+		if(run && settings.lazyJit) {
+			auto main = resolved->functions.get(context.addUnqualifiedName("main"));
+			if(!main) {
+				std::cerr << "the program has no main function" << std::endl;
+				return 1;
+			}
+
+			athena::gen::LazyJit jit{context, llcontext, settings};
+			int result;
+			std::string error;
+			if(!jit.init(error) || !jit.run(**main.force(), result, error)) {
+				std::cerr << error << std::endl;
+				return 1;
+			}
+			return result;
+		}
+
+		gen.generate(*resolved);
+	}
+
+	// The host calls main through a thunk, which is optimized together with the program.
+	// Cached modules contain the thunk already.
+	llvm::Function* thunk = nullptr;
+	if(run && cached) {
+		thunk = llmodule->getFunction("athena.main");
+	} else if(run) {
+		auto main = resolved->functions.get(context.addUnqualifiedName("main"));
+		if(!main || !(*main.force())->codegen) {
+			std::cerr << "the program has no main function" << std::endl;
+			return 1;
+		}
+
+		thunk = athena::gen::createEntryThunk(*llmodule, (llvm::Function*)(*main.force())->codegen);
+	}
+
+	// Partitioned modules are optimized separately on the thread of each partition.
+	bool partitioned = !run && settings.output != athena::OutputKind::IR && settings.codegenThreads > 1;
+	if(!partitioned && !cached) athena::gen::optimize(*llmodule, *target, settings);
 
-	std::ofstream ss("out.ll");
-	llvm::raw_os_ostream stream{ss};
-	llmodule->print(stream, nullptr);
-	llvm::verifyModule(*llmodule, &stream);
+	if(cache) {
+		// Failing to update the cache doesn't affect this compilation.
+		std::string error;
+		if(!cached && !cache->store(cacheKey, *llmodule, error)) {
+			std::cerr << error << std::endl;
+		}
+
+		cache->evict();
+		auto stats = cache->updateStats();
+		if(settings.cacheStats) athena::gen::printStats(stats, llvm::errs());
+	}
+
+	if(run) {
+		if(llvm::verifyModule(*llmodule, &llvm::errs())) return 1;
+
+		int result;
+		std::string error;
+		if(!athena::gen::runModule(std::move(llmodule), thunk, settings, result, error)) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+		return result;
+	}
+
+	if(settings.output == athena::OutputKind::IR) {
+		std::ofstream ss(settings.outputFile.empty() ? "out.ll" : settings.outputFile);
+		llvm::raw_os_ostream stream{ss};
+		llmodule->print(stream, nullptr);
+		llvm::verifyModule(*llmodule, &stream);
+	} else {
+		if(llvm::verifyModule(*llmodule, &llvm::errs())) return 1;
+
+		bool incremental = settings.incremental && settings.output == athena::OutputKind::Object;
+		auto file = settings.outputFile;
+		if(file.empty()) file = incremental ? "out.a" : settings.output == athena::OutputKind::Object ? "out.o" : "out.s";
+
+		std::string error;
+		athena::gen::IncrementalStats incrementalStats;
+		bool emitted;
+		if(incremental) {
+			emitted = athena::gen::emitIncremental(*llmodule, *target, settings.cacheDirectory, file, incrementalStats, error);
+		} else if(partitioned) {
+			emitted = athena::gen::emitPartitions(std::move(llmodule), settings, settings.codegenThreads, file, error);
+		} else {
+			emitted = athena::gen::emitFile(*llmodule, *target, file, settings.output, error);
+		}
+
+		if(!emitted) {
+			std::cerr << error << std::endl;
+			return 1;
+		}
+
+		if(incremental && settings.cacheStats) {
+			std::cerr << "functions compiled: " << incrementalStats.compiled << ", reused: " << incrementalStats.reused << std::endl;
+		}
+	}
 
     return 0;
 }
\ No newline at end of file